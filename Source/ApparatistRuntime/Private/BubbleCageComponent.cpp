@@ -14,6 +14,136 @@
 
 #include "BubbleCageComponent.h"
 
+#include "ApparatistRuntime.h"
+
+#include "Algo/BinarySearch.h"
+#include "Algo/Sort.h"
+#include "Algo/Unique.h"
+#include "Async/ParallelFor.h"
+
+
+/**
+ * The number of cells or subjects processed
+ * by a single task within the parallel passes.
+ */
+static constexpr int32 BubbleCageItemsPerTask = 4096;
+
+/**
+ * Resize a packed array, padding it for the kernel.
+ * 
+ * The padding is zeroed, while the actual elements are left uninitialized.
+ */
+static FORCEINLINE void
+SetNumPadded(TArray<float>& Array, const int32 Num)
+{
+	static constexpr int32 Padding = FBubbleCageKernel::Width - 1;
+	Array.SetNumUninitialized(Num + Padding);
+	FMemory::Memzero(Array.GetData() + Num, Padding * sizeof(float));
+}
+
+/**
+ * An axis-aligned box region of the cage queries.
+ */
+struct FBubbleCageBoxRegion
+{
+	FBox Box;
+
+	FORCEINLINE bool
+	Contains(const FBox& CellBox) const
+	{
+		return Box.IsInside(CellBox);
+	}
+
+	FORCEINLINE bool
+	Intersects(const FBox& CellBox) const
+	{
+		return Box.Intersect(CellBox);
+	}
+
+	FORCEINLINE bool
+	Overlaps(const FVector& Center, const float Radius) const
+	{
+		return Box.ComputeSquaredDistanceToPoint(Center) <= FMath::Square(Radius);
+	}
+};
+
+/**
+ * An oriented box region of the cage queries.
+ */
+struct FBubbleCageOrientedBoxRegion
+{
+	FVector Center;
+
+	FVector Extent;
+
+	FQuat Rotation;
+
+	/**
+	 * Convert a global box into the space of the region.
+	 */
+	FORCEINLINE void
+	ToLocal(const FBox& CellBox, FVector& OutCenter, FVector& OutExtent) const
+	{
+		OutCenter = Rotation.UnrotateVector(CellBox.GetCenter() - Center);
+		const auto CellExtent = CellBox.GetExtent();
+		const auto AxisX = Rotation.GetAxisX().GetAbs();
+		const auto AxisY = Rotation.GetAxisY().GetAbs();
+		const auto AxisZ = Rotation.GetAxisZ().GetAbs();
+		OutExtent = FVector(AxisX | CellExtent, AxisY | CellExtent, AxisZ | CellExtent);
+	}
+
+	FORCEINLINE bool
+	Contains(const FBox& CellBox) const
+	{
+		FVector LocalCenter, LocalExtent;
+		ToLocal(CellBox, LocalCenter, LocalExtent);
+		return (LocalCenter.GetAbs() + LocalExtent).ComponentwiseAllLessOrEqual(Extent);
+	}
+
+	FORCEINLINE bool
+	Intersects(const FBox& CellBox) const
+	{
+		// Only the axes of the region are tested here, which is conservative...
+		FVector LocalCenter, LocalExtent;
+		ToLocal(CellBox, LocalCenter, LocalExtent);
+		return (LocalCenter.GetAbs() - LocalExtent).ComponentwiseAllLessOrEqual(Extent);
+	}
+
+	FORCEINLINE bool
+	Overlaps(const FVector& Point, const float Radius) const
+	{
+		const auto LocalPoint = Rotation.UnrotateVector(Point - Center);
+		const auto Excess = (LocalPoint.GetAbs() - Extent).ComponentMax(FVector::ZeroVector);
+		return Excess.SizeSquared() <= FMath::Square(Radius);
+	}
+};
+
+/**
+ * A convex volume region of the cage queries.
+ */
+struct FBubbleCageConvexRegion
+{
+	const FConvexVolume& Volume;
+
+	FORCEINLINE bool
+	Contains(const FBox& CellBox) const
+	{
+		bool bFullyContained = false;
+		return Volume.IntersectBox(CellBox.GetCenter(), CellBox.GetExtent(), bFullyContained) && bFullyContained;
+	}
+
+	FORCEINLINE bool
+	Intersects(const FBox& CellBox) const
+	{
+		return Volume.IntersectBox(CellBox.GetCenter(), CellBox.GetExtent());
+	}
+
+	FORCEINLINE bool
+	Overlaps(const FVector& Point, const float Radius) const
+	{
+		return Volume.IntersectSphere(Point, Radius);
+	}
+};
 
 UBubbleCageComponent::UBubbleCageComponent()
 {
@@ -23,8 +153,1586 @@ UBubbleCageComponent::UBubbleCageComponent()
 void
 UBubbleCageComponent::InitializeComponent()
 {
+	if (bPlanar)
+	{
+		Size.Z = 1;
+	}
 	DoInitializeCells();
 	GetBounds();
 	InvCellSizeCache = 1 / CellSize;
 	bInitialized = true;
 }
+
+void
+UBubbleCageComponent::ApplyWorldOffset(const FVector& InOffset, bool bWorldShift)
+{
+	Super::ApplyWorldOffset(InOffset, bWorldShift);
+	if (bInitialized)
+	{
+		ShiftWorld(InOffset);
+	}
+}
+
+void
+UBubbleCageComponent::Rebase(const FVector& Offset)
+{
+	WaitForEvaluation();
+	Bounds = Bounds.ShiftBy(Offset);
+
+	// The bubbles stay in place, so their
+	// cage-local snapshots move the other way...
+	const auto LocalOffset = FVector3f(Offset);
+	static const auto Filter = FFilter::Make<FLocated, FBubbleSphere>();
+	GetMechanism()->EnchainSolid(Filter)->OperateConcurrently(
+	[&](FSolidSubjectHandle,
+		const FLocated&,
+		FBubbleSphere&      BubbleSphere)
+	{
+		BubbleSphere.CageLocation -= LocalOffset;
+		BubbleSphere.RestLocation -= LocalOffset;
+		BubbleSphere.SweptLocation -= LocalOffset;
+	}, ThreadsCount);
+
+	if (bCellsFilled)
+	{
+		// The cells are laid out relative to the bounds,
+		// while the packed snapshots are re-derived here as well...
+		Update();
+	}
+}
+
+void
+UBubbleCageComponent::ShiftWorld(const FVector& Offset)
+{
+	WaitForEvaluation();
+	Bounds = Bounds.ShiftBy(Offset);
+
+	// The bubbles follow the cage, so their
+	// cage-local snapshots remain intact...
+	static const auto Filter = FFilter::Make<FLocated, FBubbleSphere>();
+	GetMechanism()->EnchainSolid(Filter)->OperateConcurrently(
+	[&](FSolidSubjectHandle,
+		FLocated&           Located,
+		FBubbleSphere&)
+	{
+		Located.Location += Offset;
+	}, ThreadsCount);
+}
+
+FGraphEventRef
+UBubbleCageComponent::EvaluateAsync()
+{
+	WaitForEvaluation();
+
+	// The actor-backed bubbles may only be changed
+	// on the game thread, so evaluate those in place...
+	if (bActorBubbles)
+	{
+		if (!bSynchronousEvaluationReported)
+		{
+			UE_LOG(LogApparatist, Warning,
+				   TEXT("The '%s' bubble cage may have the actor-backed bubbles, so it is evaluated synchronously. Disable its actor bubbles option to evaluate asynchronously."),
+				   *GetName());
+			bSynchronousEvaluationReported = true;
+		}
+		Solve();
+		PendingEvaluation = FGraphEvent::CreateGraphEvent();
+		PendingEvaluation->DispatchSubsequents();
+		return PendingEvaluation;
+	}
+
+	PendingEvaluation = FFunctionGraphTask::CreateAndDispatchWhenReady([this]()
+	{
+		// The nested calls must not wait for themselves...
+		EvaluatingThreadId.store(FPlatformTLS::GetCurrentThreadId(), std::memory_order_release);
+		Solve();
+		EvaluatingThreadId.store(0, std::memory_order_release);
+	}, TStatId(), nullptr, ENamedThreads::AnyHiPriThreadNormalTask);
+	return PendingEvaluation;
+}
+
+void
+UBubbleCageComponent::WaitForEvaluation()
+{
+	if (EvaluatingThreadId.load(std::memory_order_acquire) == FPlatformTLS::GetCurrentThreadId())
+	{
+		// Called from within the evaluation itself.
+		return;
+	}
+	if (!PendingEvaluation.IsValid()) return;
+	FTaskGraphInterface::Get().WaitUntilTaskCompletes(PendingEvaluation);
+	PendingEvaluation = nullptr;
+	if (bDeferredsPending)
+	{
+		bDeferredsPending = false;
+		GetMechanism()->ApplyDeferreds();
+	}
+}
+
+void
+UBubbleCageComponent::ApplyDeferreds()
+{
+	if (EvaluatingThreadId.load(std::memory_order_acquire) == FPlatformTLS::GetCurrentThreadId())
+	{
+		// Leave those to the game thread...
+		bDeferredsPending = true;
+		return;
+	}
+	GetMechanism()->ApplyDeferreds();
+}
+
+void
+UBubbleCageComponent::ResetSparseCells(const int32 SlotsNum)
+{
+	check(FMath::IsPowerOfTwo(SlotsNum));
+	if (SparseKeys.Num() != SlotsNum)
+	{
+		SparseKeys.SetNumUninitialized(SlotsNum);
+		CellOffsets.SetNumZeroed(SlotsNum + 1);
+		CellCounts.SetNumUninitialized(SlotsNum);
+		CellFingerprints.SetNum(SlotsNum);
+		CellLayers.SetNumZeroed(SlotsNum);
+	}
+	// The counts may be left dirty by an overflown histogram,
+	// even within the preserved part of a grown table...
+	FMemory::Memzero(CellCounts.GetData(), SlotsNum * sizeof(int32));
+	FMemory::Memset(SparseKeys.GetData(), 0xFF, SlotsNum * sizeof(uint64));
+	SparseCellsNum.store(0, std::memory_order_relaxed);
+}
+
+void
+UBubbleCageComponent::UpdatePacked()
+{
+	const auto Mechanism = GetMechanism();
+
+	if (bSparseCells)
+	{
+		// Keep the hash table at most half-full,
+		// judging by the previous population...
+		const auto DesiredSlotsNum = (int32)FMath::RoundUpToPowerOfTwo(FMath::Max(MinSparseCellsNum, 2 * PackedSubjects.Num()));
+		const auto SlotsNum = ((SparseKeys.Num() < DesiredSlotsNum) || (SparseKeys.Num() > 4 * DesiredSlotsNum))
+							? DesiredSlotsNum : SparseKeys.Num();
+		ResetSparseCells(SlotsNum);
+	}
+
+	// Use atomic for a thread safety:
+	const auto LevelsNum = GetLevelsNum();
+	std::atomic<float> AtomicLevelLargestRadii[MaxLevelsCount];
+	for (int32 Level = 0; Level < LevelsNum; ++Level)
+	{
+		AtomicLevelLargestRadii[Level].store(-1.0f, std::memory_order_relaxed);
+	}
+	std::atomic<float> AtomicLowestHeight{TNumericLimits<float>::Max()};
+	std::atomic<float> AtomicHighestHeight{TNumericLimits<float>::Lowest()};
+	std::atomic<bool> bAtomicOverflow{false};
+
+	// Build the histogram...
+	// The previous count of the cell is the rank of the subject within it.
+	static const auto Filter = FFilter::Make<FLocated, FBubbleSphere>();
+	do
+	{
+		if (bAtomicOverflow.load(std::memory_order_relaxed))
+		{
+			// The population has outgrown the hash table, so start over...
+			bAtomicOverflow.store(false, std::memory_order_relaxed);
+			for (int32 Level = 0; Level < LevelsNum; ++Level)
+			{
+				AtomicLevelLargestRadii[Level].store(-1.0f, std::memory_order_relaxed);
+			}
+			ResetSparseCells(2 * SparseKeys.Num());
+		}
+		Mechanism->EnchainSolid(Filter)->OperateConcurrently(
+		[&](FSolidSubjectHandle Subject,
+			FLocated&           Located,
+			FBubbleSphere&      BubbleSphere)
+		{
+			if (UNLIKELY(!IsInside(Located.Location) && !ConfineToBounds(Located.Location)))
+			{
+				BubbleSphere.CellIndex = -1;
+				BubbleSphere.PackedIndex = -1;
+				Subject.DespawnDeferred();
+				return;
+			}
+			const auto Location = Located.Location;
+
+			// Solve the largest radius of the level...
+			const auto Level = GetLevelOf(BubbleSphere.Radius);
+			AtomicMax(AtomicLevelLargestRadii[Level], BubbleSphere.Radius);
+			GatherHeight(AtomicLowestHeight, AtomicHighestHeight, Location);
+
+			const auto CellPoint = ClampToLevel(WorldToCage(Location, Level), Level);
+			if (bSparseCells)
+			{
+				BubbleSphere.CellIndex = FindOrAddSparseCell(MakeSparseKey(CellPoint, Level));
+				if (UNLIKELY(BubbleSphere.CellIndex == INDEX_NONE))
+				{
+					bAtomicOverflow.store(true, std::memory_order_relaxed);
+					return;
+				}
+			}
+			else
+			{
+				BubbleSphere.CellIndex = FindCellIndex(CellPoint, Level);
+			}
+			BubbleSphere.PackedIndex = FPlatformAtomics::InterlockedIncrement(&CellCounts[BubbleSphere.CellIndex]) - 1;
+		}, ThreadsCount);
+	}
+	while (bAtomicOverflow.load(std::memory_order_relaxed));
+
+	const auto CellsNum = CellCounts.Num();
+	const auto TasksNum = FMath::DivideAndRoundUp(CellsNum, BubbleCageItemsPerTask);
+
+	// Prefix-sum the histogram...
+	TArray<int32, TInlineAllocator<256>> TaskOffsets;
+	TaskOffsets.SetNumUninitialized(TasksNum + 1);
+	ParallelFor(TasksNum, [&](const int32 Task)
+	{
+		const auto End = FMath::Min(CellsNum, (Task + 1) * BubbleCageItemsPerTask);
+		int32 Sum = 0;
+		for (int32 i = Task * BubbleCageItemsPerTask; i < End; ++i)
+		{
+			Sum += CellCounts[i];
+		}
+		TaskOffsets[Task] = Sum;
+	});
+	int32 Total = 0;
+	for (int32 Task = 0; Task < TasksNum; ++Task)
+	{
+		const auto Sum = TaskOffsets[Task];
+		TaskOffsets[Task] = Total;
+		Total += Sum;
+	}
+	ParallelFor(TasksNum, [&](const int32 Task)
+	{
+		const auto End = FMath::Min(CellsNum, (Task + 1) * BubbleCageItemsPerTask);
+		auto Offset = TaskOffsets[Task];
+		for (int32 i = Task * BubbleCageItemsPerTask; i < End; ++i)
+		{
+			CellOffsets[i] = Offset;
+			Offset += CellCounts[i];
+			// Prepare for the next update:
+			CellCounts[i] = 0;
+		}
+	});
+	CellOffsets[CellsNum] = Total;
+
+	// Scatter the subjects along with their snapshots...
+	// The kernel reads whole batches, so pad the arrays accordingly:
+	PackedSubjects.SetNumUninitialized(Total);
+	SetNumPadded(PackedLocationsX, Total);
+	SetNumPadded(PackedLocationsY, Total);
+	SetNumPadded(PackedLocationsZ, Total);
+	SetNumPadded(PackedRadii, Total);
+	SetNumPadded(PackedDecoupleProportions, Total);
+	PackedLayers.SetNumUninitialized(Total);
+	PackedMasks.SetNumUninitialized(Total);
+	Mechanism->EnchainSolid(Filter)->OperateConcurrently(
+	[&](FSolidSubjectHandle Subject,
+		const FLocated&     Located,
+		FBubbleSphere&      BubbleSphere)
+	{
+		if (UNLIKELY(BubbleSphere.CellIndex < 0)) return;
+		const auto PackedIndex = BubbleSphere.PackedIndex + CellOffsets[BubbleSphere.CellIndex];
+		BubbleSphere.PackedIndex = PackedIndex;
+		PackedSubjects[PackedIndex] = (FSubjectHandle)Subject;
+		SetPackedLocation(PackedIndex, Located.Location);
+		PackedRadii[PackedIndex] = BubbleSphere.Radius;
+		PackedDecoupleProportions[PackedIndex] = BubbleSphere.DecoupleProportion;
+		PackedLayers[PackedIndex] = (uint32)BubbleSphere.CollisionLayers;
+		PackedMasks[PackedIndex] = (uint32)BubbleSphere.CollisionMask;
+	}, ThreadsCount);
+
+	if (bDeterministic)
+	{
+		// The ranks within the cells were
+		// distributed by the racing threads...
+		SortCells();
+	}
+
+	// Accumulate the fingerprints and the layers of the occupied cells...
+	ParallelFor(TasksNum, [&](const int32 Task)
+	{
+		const auto End = FMath::Min(CellsNum, (Task + 1) * BubbleCageItemsPerTask);
+		for (int32 i = Task * BubbleCageItemsPerTask; i < End; ++i)
+		{
+			const auto SubjectsEnd = CellOffsets[i + 1];
+			auto SubjectIndex = CellOffsets[i];
+			if (SubjectIndex == SubjectsEnd) continue;
+			auto& Fingerprint = CellFingerprints[i];
+			Fingerprint.Reset();
+			uint32 Layers = 0;
+			for (; SubjectIndex < SubjectsEnd; ++SubjectIndex)
+			{
+				Fingerprint.Add(PackedSubjects[SubjectIndex].GetFingerprint());
+				Layers |= PackedLayers[SubjectIndex];
+			}
+			CellLayers[i] = Layers;
+		}
+	});
+
+	LowestHeight = AtomicLowestHeight.load(std::memory_order_relaxed);
+	HighestHeight = AtomicHighestHeight.load(std::memory_order_relaxed);
+	LargestRadius = 0;
+	for (int32 Level = 0; Level < LevelsNum; ++Level)
+	{
+		LevelLargestRadii[Level] = AtomicLevelLargestRadii[Level].load(std::memory_order_relaxed);
+		LargestRadius = FMath::Max(LargestRadius, LevelLargestRadii[Level]);
+	}
+	DisplacementSlack = 0;
+	bCellsFilled = true;
+}
+
+void
+UBubbleCageComponent::UpdateIncrementally()
+{
+	const auto Mechanism = GetMechanism();
+
+	// Use atomic for a thread safety:
+	std::atomic<float> AtomicLargestRadius{0};
+	std::atomic<float> AtomicLowestHeight{TNumericLimits<float>::Max()};
+	std::atomic<float> AtomicHighestHeight{TNumericLimits<float>::Lowest()};
+
+	// Move only the subjects that have changed their cells...
+	static const auto Filter = FFilter::Make<FLocated, FBubbleSphere>();
+	Mechanism->EnchainSolid(Filter)->OperateConcurrently(
+	[&](FSolidSubjectHandle Subject,
+		FLocated&           Located,
+		FBubbleSphere&      BubbleSphere)
+	{
+		if (UNLIKELY(!IsInside(Located.Location) && !ConfineToBounds(Located.Location)))
+		{
+			MoveToCell((FSubjectHandle)Subject, BubbleSphere, INDEX_NONE);
+			Subject.DespawnDeferred();
+			return;
+		}
+		const auto Location = Located.Location;
+
+		// Solve the largest radius...
+		AtomicMax(AtomicLargestRadius, BubbleSphere.Radius);
+		GatherHeight(AtomicLowestHeight, AtomicHighestHeight, Location);
+
+		BubbleSphere.CageLocation = FVector3f(WorldToBounded(Location));
+		const auto NewCellIndex = GetIndexAt(Location);
+		if (LIKELY(BubbleSphere.CellIndex == NewCellIndex))
+		{
+			RefreshInCell((FSubjectHandle)Subject, BubbleSphere);
+			return;
+		}
+		MoveToCell((FSubjectHandle)Subject, BubbleSphere, NewCellIndex);
+	}, ThreadsCount);
+
+	LargestRadius = AtomicLargestRadius.load(std::memory_order_relaxed);
+	LevelLargestRadii[0] = LargestRadius;
+	LowestHeight = AtomicLowestHeight.load(std::memory_order_relaxed);
+	HighestHeight = AtomicHighestHeight.load(std::memory_order_relaxed);
+
+	if (++UpdatesSinceCompaction >= CompactionPeriod)
+	{
+		CompactCells();
+	}
+}
+
+void
+UBubbleCageComponent::DequeueOccupiedCells(TArray<int32>& OutOccupied)
+{
+	// The cells get enqueued each time they become occupied,
+	// so there may be duplicates among them...
+	OutOccupied.Reset();
+	int32 CellIndex;
+	while (OccupiedCells.Dequeue(CellIndex))
+	{
+		OutOccupied.Add(CellIndex);
+	}
+	OutOccupied.Sort();
+	OutOccupied.SetNum(Algo::Unique(OutOccupied));
+}
+
+void
+UBubbleCageComponent::CompactCells()
+{
+	TArray<int32> Occupied;
+	DequeueOccupiedCells(Occupied);
+
+	ParallelFor(Occupied.Num(), [&](const int32 i)
+	{
+		auto& Cell = Cells[Occupied[i]];
+		Cell.Fingerprint.Reset();
+		Cell.Layers = 0;
+		const auto SubjectsNum = Cell.Subjects.Num();
+		for (int32 t = SubjectsNum - 1; t >= 0; --t)
+		{
+			const auto Subject = Cell.Subjects[t];
+			if (Subject)
+			{
+				Cell.Fingerprint.Add(Subject.GetFingerprint());
+				Cell.Layers |= Cell.Occupants[t].Layers;
+			}
+			else
+			{
+				RemoveFromCell(Cell, t);
+			}
+		}
+		if (Cell.Subjects.Num() < SubjectsNum)
+		{
+			CellOccupantsNum.fetch_sub(SubjectsNum - Cell.Subjects.Num(), std::memory_order_relaxed);
+		}
+	});
+
+	for (const auto Index : Occupied)
+	{
+		if (Cells[Index].Subjects.Num() > 0)
+		{
+			OccupiedCells.Enqueue(Index);
+		}
+	}
+	UpdatesSinceCompaction = 0;
+}
+
+void
+UBubbleCageComponent::SortCells()
+{
+	const auto ById = [](const FSubjectHandle& A, const FSubjectHandle& B)
+	{
+		return A.GetId() < B.GetId();
+	};
+
+	if (IsPacked())
+	{
+		const auto CellsNum = CellCounts.Num();
+		const auto TasksNum = FMath::DivideAndRoundUp(CellsNum, BubbleCageItemsPerTask);
+		ParallelFor(TasksNum, [&](const int32 Task)
+		{
+			const auto End = FMath::Min(CellsNum, (Task + 1) * BubbleCageItemsPerTask);
+			for (int32 i = Task * BubbleCageItemsPerTask; i < End; ++i)
+			{
+				const auto SubjectsBegin = CellOffsets[i];
+				const auto SubjectsEnd = CellOffsets[i + 1];
+				if (SubjectsEnd - SubjectsBegin < 2) continue;
+				Algo::Sort(TArrayView<FSubjectHandle>(PackedSubjects.GetData() + SubjectsBegin,
+													  SubjectsEnd - SubjectsBegin), ById);
+				// Re-gather the snapshots in the new order...
+				for (int32 t = SubjectsBegin; t < SubjectsEnd; ++t)
+				{
+					auto Subject = (FSolidSubjectHandle)PackedSubjects[t];
+					auto& BubbleSphere = Subject.GetTraitRef<FBubbleSphere>();
+					BubbleSphere.PackedIndex = t;
+					SetPackedLocation(t, Subject.GetTraitRef<FLocated>().Location);
+					PackedRadii[t] = BubbleSphere.Radius;
+					PackedDecoupleProportions[t] = BubbleSphere.DecoupleProportion;
+					PackedLayers[t] = (uint32)BubbleSphere.CollisionLayers;
+					PackedMasks[t] = (uint32)BubbleSphere.CollisionMask;
+				}
+			}
+		});
+		return;
+	}
+
+	TArray<int32> Occupied;
+	DequeueOccupiedCells(Occupied);
+
+	// The cells are small, so an insertion sort is just fine...
+	ParallelFor(Occupied.Num(), [&](const int32 i)
+	{
+		auto& Cell = Cells[Occupied[i]];
+		for (int32 t = 1; t < Cell.Subjects.Num(); ++t)
+		{
+			for (int32 k = t; (k > 0) && ById(Cell.Subjects[k], Cell.Subjects[k - 1]); --k)
+			{
+				Swap(Cell.Subjects[k], Cell.Subjects[k - 1]);
+				Swap(Cell.Occupants[k], Cell.Occupants[k - 1]);
+			}
+		}
+		for (int32 t = 0; t < Cell.Subjects.Num(); ++t)
+		{
+			SetCellSlot(Cell.Subjects[t], t);
+		}
+	});
+
+	for (const auto Index : Occupied)
+	{
+		OccupiedCells.Enqueue(Index);
+	}
+}
+
+void
+UBubbleCageComponent::BeginContacts()
+{
+	// Warm-start with the previous number of contacts...
+	GatheredContacts.SetNumUninitialized(FMath::Max(MinContactsNum, Contacts.Num() + Contacts.Num() / 2), /*bAllowShrinking=*/false);
+	ContactsCursor.store(0, std::memory_order_relaxed);
+	OverflowContacts.Reset();
+}
+
+void
+UBubbleCageComponent::EndContacts()
+{
+	const auto GatheredNum = FMath::Min(ContactsCursor.load(std::memory_order_relaxed), GatheredContacts.Num());
+	GatheredContacts.SetNum(GatheredNum, /*bAllowShrinking=*/false);
+	GatheredContacts.Append(OverflowContacts);
+	OverflowContacts.Reset();
+	const auto ByKey = [](const FBubbleCageContact& A, const FBubbleCageContact& B)
+	{
+		return A.GetKey() < B.GetKey();
+	};
+	Algo::Sort(GatheredContacts, ByKey);
+	// The bubbles waking the others register their pairs on their own...
+	GatheredContacts.SetNum(Algo::Unique(GatheredContacts, [](const FBubbleCageContact& A, const FBubbleCageContact& B)
+	{
+		return (A.SubjectA == B.SubjectA) && (A.SubjectB == B.SubjectB);
+	}), /*bAllowShrinking=*/false);
+
+	// The sleeping bubbles don't detect anything,
+	// so the contacts between those are carried on as they were.
+	// The awake ones register their contacts with the sleeping ones on their own...
+	TArray<FBubbleCageContact> CarriedContacts;
+	const auto EndContact = [&](const FBubbleCageContact& Contact)
+	{
+		if (IsAsleep(Contact.SubjectA) && IsAsleep(Contact.SubjectB))
+		{
+			PersistingContacts.Add(Contact);
+			CarriedContacts.Add(Contact);
+			return;
+		}
+		EndedContacts.Add(Contact);
+	};
+
+	// Merge with the previous contacts, which are sorted as well...
+	BeganContacts.Reset();
+	PersistingContacts.Reset();
+	EndedContacts.Reset();
+	int32 i = 0, j = 0;
+	while ((i < GatheredContacts.Num()) || (j < Contacts.Num()))
+	{
+		if (j == Contacts.Num())
+		{
+			BeganContacts.Add(GatheredContacts[i++]);
+			continue;
+		}
+		if (i == GatheredContacts.Num())
+		{
+			EndContact(Contacts[j++]);
+			continue;
+		}
+		const auto Key = GatheredContacts[i].GetKey();
+		const auto PreviousKey = Contacts[j].GetKey();
+		if (Key < PreviousKey)
+		{
+			BeganContacts.Add(GatheredContacts[i++]);
+		}
+		else if (Key > PreviousKey)
+		{
+			EndContact(Contacts[j++]);
+		}
+		else if ((GatheredContacts[i].SubjectA == Contacts[j].SubjectA) &&
+				 (GatheredContacts[i].SubjectB == Contacts[j].SubjectB))
+		{
+			PersistingContacts.Add(GatheredContacts[i++]);
+			++j;
+		}
+		else
+		{
+			// The identifiers were reused by the new subjects...
+			BeganContacts.Add(GatheredContacts[i++]);
+			EndedContacts.Add(Contacts[j++]);
+		}
+	}
+	if (CarriedContacts.Num() > 0)
+	{
+		GatheredContacts.Append(CarriedContacts);
+		Algo::Sort(GatheredContacts, ByKey);
+	}
+
+	// The previous contacts become the storage for the next gathering...
+	Swap(Contacts, GatheredContacts);
+}
+
+void
+UBubbleCageComponent::WakeSubjects()
+{
+	static const auto Filter = FFilter::Make<FLocated, FBubbleSphere>();
+	FSubjectHandle Subject;
+	while (WokenSubjects.Dequeue(Subject))
+	{
+		auto Bubble = (FSolidSubjectHandle)Subject;
+		if (UNLIKELY(!Bubble || !Bubble.Matches(Filter))) continue;
+		// The rest is counted anew, while the location is kept...
+		Bubble.GetTraitRef<FBubbleSphere>().RestingCount = 0;
+	}
+}
+
+bool
+UBubbleCageComponent::Sweep(const FSubjectHandle& Subject,
+							const FLocated&       Located,
+							FBubbleSphere&        BubbleSphere) const
+{
+	auto LocalStart = BubbleSphere.SweptLocation;
+	const auto LocalEnd = FVector3f(WorldToBounded(Located.Location));
+	const auto bRecorded = BubbleSphere.bSwept;
+	BubbleSphere.SweptLocation = LocalEnd;
+	BubbleSphere.bSwept = true;
+	if (UNLIKELY(!bRecorded)) return false;
+	if (bPlanar)
+	{
+		// The height is passed through...
+		LocalStart.Z = LocalEnd.Z;
+	}
+
+	auto Direction = LocalEnd - LocalStart;
+	const auto Length = Direction.Size();
+	// Only the bubbles moving farther than their radius may tunnel...
+	if (Length <= BubbleSphere.Radius) return false;
+	if ((BoundsPolicy == EBubbleCageBoundsPolicy::Wrap) && (2 * Length > Bounds.GetSize().GetMin()))
+	{
+		// The bubble has been wrapped around.
+		return false;
+	}
+	Direction /= Length;
+
+	const auto Radius = BubbleSphere.Radius;
+	const auto Layers = (uint32)BubbleSphere.CollisionLayers;
+	const auto Mask = (uint32)BubbleSphere.CollisionMask;
+	auto ClosestDistance = Length;
+	bool bHit = false;
+	const auto TestOccupant = [&](const FOccupant& Occupant)
+	{
+		if (UNLIKELY(!Occupant.Subject || (Occupant.Subject == Subject))) return;
+		if (!(Occupant.Layers & Mask) || !(Occupant.Mask & Layers)) return;
+		const auto Reach = Radius + Occupant.Radius;
+		auto Offset = LocalStart - Occupant.Location;
+		if (bPlanar)
+		{
+			Offset.Z = 0;
+		}
+		const auto Projection = Offset | Direction;
+		const auto Excess = Offset.SizeSquared() - Reach * Reach;
+		if ((Excess <= 0) || (Projection >= 0)) return;
+		const auto Discriminant = Projection * Projection - Excess;
+		if (Discriminant < 0) return;
+		const auto Distance = -Projection - FMath::Sqrt(Discriminant);
+		if (Distance >= ClosestDistance) return;
+		ClosestDistance = Distance;
+		bHit = true;
+	};
+
+	for (int32 Level = 0; Level < LevelLargestRadii.Num(); ++Level)
+	{
+		const auto LevelLargestRadius = LevelLargestRadii[Level];
+		if (LevelLargestRadius < 0) continue; // The level is empty.
+		ForEachCellAlong(Level, LocalStart, Direction, Length, Radius + LevelLargestRadius + DisplacementSlack,
+		[&](const int32 CellIndex, const float Distance)
+		{
+			// Nothing closer can be hit from now on,
+			// except for the overflowing border bubbles...
+			if (Distance > ClosestDistance) return BoundsPolicy == EBubbleCageBoundsPolicy::Overflow;
+			if (!(GetCellLayers(CellIndex) & Mask)) return true;
+			ForEachOccupantIn(CellIndex, TestOccupant);
+			return true;
+		});
+	}
+	if (!bHit) return false;
+
+	const auto Impact = LocalStart + Direction * ClosestDistance;
+	BubbleSphere.AccumulatedDecouple = FVector(Impact - LocalEnd);
+	BubbleSphere.AccumulatedDecoupleCount = 1;
+	BubbleSphere.SweptLocation = Impact;
+	return true;
+}
+
+void
+UBubbleCageComponent::DetectPairwise()
+{
+	const auto SubjectsNum = PackedSubjects.Num();
+	const auto CellsNum = CellOffsets.Num() - 1;
+	const auto ChunksNum = FMath::Max(1, ThreadsCount);
+	const auto bContacts = IsGatheringContacts();
+	PairwiseDecouples.SetNum(ChunksNum);
+
+	// Gather the forward half of the neighbourhood for each of the levels.
+	// Both of the bubbles may have drifted away from their cells,
+	// so the slack is accounted twice here...
+	const auto LevelsNum = LevelLargestRadii.Num();
+	TArray<TArray<FIntVector, TInlineAllocator<64>>, TInlineAllocator<MaxLevelsCount>> HalfStencils;
+	HalfStencils.SetNum(LevelsNum);
+	for (int32 Level = 0; Level < LevelsNum; ++Level)
+	{
+		if (LevelLargestRadii[Level] < 0) continue; // The level is empty.
+		const auto Reach = FMath::CeilToInt(2 * (LevelLargestRadii[Level] + DisplacementSlack) * InvCellSizeCache / (1 << Level));
+		auto& HalfStencil = HalfStencils[Level];
+		for (int32 k = 0; k <= Reach; ++k)
+		{
+			for (int32 j = (k > 0) ? -Reach : 0; j <= Reach; ++j)
+			{
+				for (int32 i = ((k > 0) || (j > 0)) ? -Reach : 1; i <= Reach; ++i)
+				{
+					HalfStencil.Add(FIntVector(i, j, k));
+				}
+			}
+		}
+	}
+
+	const auto Subjects = PackedSubjects.GetData();
+	const auto LocationsX = PackedLocationsX.GetData();
+	const auto LocationsY = PackedLocationsY.GetData();
+	const auto LocationsZ = PackedLocationsZ.GetData();
+	const auto Radii = PackedRadii.GetData();
+	const auto DecoupleProportions = PackedDecoupleProportions.GetData();
+	const auto Layers = PackedLayers.GetData();
+	const auto Masks = PackedMasks.GetData();
+	const auto Offsets = TArrayView<const int32>(CellOffsets.GetData(), CellsNum);
+
+	// Use atomic for a thread safety:
+	std::atomic<float> AtomicMaxPenetration{0};
+
+	// Each of the chunks gets an equal share of the subjects...
+	ParallelFor(ChunksNum, [&](const int32 Chunk)
+	{
+		float Penetration = 0.0f;
+		auto& Decouples = PairwiseDecouples[Chunk];
+		Decouples.SetNumUninitialized(SubjectsNum);
+		FMemory::Memzero(Decouples.GetData(), SubjectsNum * sizeof(FVector4f));
+
+		const auto CouplePair = [&](const int32 A, const int32 B)
+		{
+			const auto ProportionA = DecoupleProportions[A];
+			const auto ProportionB = DecoupleProportions[B];
+			if (UNLIKELY((ProportionA <= 0.0f) && (ProportionB <= 0.0f))) return;
+			if (UNLIKELY(!Subjects[B])) return;
+			if (!(Layers[A] & Masks[B]) || !(Layers[B] & Masks[A])) return;
+			if (bContacts)
+			{
+				AddContact(Subjects[A], Subjects[B]);
+			}
+			const auto Delta = FVector3f(LocationsX[A] - LocationsX[B],
+										 LocationsY[A] - LocationsY[B],
+										 LocationsZ[A] - LocationsZ[B]);
+			const auto Distance = FMath::Sqrt(Delta.SizeSquared());
+			const float DistanceDelta = Radii[A] + Radii[B] - Distance;
+			Penetration = FMath::Max(Penetration, DistanceDelta);
+			FVector3f Direction;
+			if (UNLIKELY(Distance <= SMALL_NUMBER))
+			{
+				// The distance is too small to get the direction.
+				// Use the ids to get the direction.
+				Direction = (Subjects[A].GetId() > Subjects[B].GetId()) ? FVector3f::LeftVector : FVector3f::RightVector;
+			}
+			else
+			{
+				Direction = Delta / Distance;
+			}
+			const auto Correction = Direction * (DistanceDelta / (ProportionA + ProportionB));
+			if (ProportionA > 0.0f)
+			{
+				Decouples[A] += FVector4f(Correction * ProportionA, 1.0f);
+			}
+			if (ProportionB > 0.0f)
+			{
+				Decouples[B] += FVector4f(Correction * -ProportionB, 1.0f);
+			}
+		};
+
+		const auto CellsBegin = Algo::LowerBound(Offsets, (int32)(((int64)SubjectsNum * Chunk) / ChunksNum));
+		const auto CellsEnd = Algo::LowerBound(Offsets, (int32)(((int64)SubjectsNum * (Chunk + 1)) / ChunksNum));
+		TArray<TPair<int32, int32>, TInlineAllocator<64>> NeighbourRanges;
+		for (int32 CellIndex = CellsBegin; CellIndex < CellsEnd; ++CellIndex)
+		{
+			const auto Begin = CellOffsets[CellIndex];
+			const auto End = CellOffsets[CellIndex + 1];
+			if (Begin == End) continue;
+
+			int32 Level;
+			const auto CellPoint = GetCellPoint(CellIndex, Level);
+			NeighbourRanges.Reset();
+			for (const auto& Offset : HalfStencils[Level])
+			{
+				const auto NeighbourCellIndex = FindCellIndex(CellPoint + Offset, Level);
+				if (NeighbourCellIndex == INDEX_NONE) continue;
+				const auto NeighbourBegin = CellOffsets[NeighbourCellIndex];
+				const auto NeighbourEnd = CellOffsets[NeighbourCellIndex + 1];
+				if (NeighbourBegin != NeighbourEnd)
+				{
+					NeighbourRanges.Emplace(NeighbourBegin, NeighbourEnd);
+				}
+			}
+
+			for (int32 A = Begin; A < End; ++A)
+			{
+				if (UNLIKELY(!Subjects[A])) continue;
+				const auto Location = FVector3f(LocationsX[A], LocationsY[A], LocationsZ[A]);
+				const auto Radius = Radii[A];
+				const auto Couple = [&](const int32 B)
+				{
+					CouplePair(A, B);
+				};
+				// The later subjects of the same cell...
+				FBubbleCageKernel::ForEachOverlapping(Location, Radius,
+													  LocationsX, LocationsY, LocationsZ, Radii,
+													  A + 1, End, Couple);
+				// All the subjects of the forward neighbours...
+				for (const auto& Range : NeighbourRanges)
+				{
+					FBubbleCageKernel::ForEachOverlapping(Location, Radius,
+														  LocationsX, LocationsY, LocationsZ, Radii,
+														  Range.Key, Range.Value, Couple);
+				}
+				// The cross-level pairs are enumerated by their smaller bubbles only,
+				// while the current location of this one is already known...
+				for (int32 UpperLevel = Level + 1; UpperLevel < LevelsNum; ++UpperLevel)
+				{
+					const auto UpperLargestRadius = LevelLargestRadii[UpperLevel];
+					if (UpperLargestRadius < 0) continue; // The level is empty.
+					ForEachCellWithin(UpperLevel, FVector(Location), Radius + UpperLargestRadius + DisplacementSlack,
+					[&](const int32 UpperCellIndex)
+					{
+						FBubbleCageKernel::ForEachOverlapping(Location, Radius,
+															  LocationsX, LocationsY, LocationsZ, Radii,
+															  CellOffsets[UpperCellIndex], CellOffsets[UpperCellIndex + 1],
+															  Couple);
+					});
+				}
+			}
+		}
+		AtomicMax(AtomicMaxPenetration, Penetration);
+	});
+	MaxPenetration = AtomicMaxPenetration.load(std::memory_order_relaxed);
+
+	// Reduce the per-thread accumulators into the first one...
+	const auto TasksNum = FMath::DivideAndRoundUp(SubjectsNum, BubbleCageItemsPerTask);
+	ParallelFor(TasksNum, [&](const int32 Task)
+	{
+		const auto End = FMath::Min(SubjectsNum, (Task + 1) * BubbleCageItemsPerTask);
+		auto Result = PairwiseDecouples[0].GetData();
+		for (int32 Chunk = 1; Chunk < ChunksNum; ++Chunk)
+		{
+			const auto Decouples = PairwiseDecouples[Chunk].GetData();
+			for (int32 i = Task * BubbleCageItemsPerTask; i < End; ++i)
+			{
+				Result[i] += Decouples[i];
+			}
+		}
+	});
+}
+
+void
+UBubbleCageComponent::DetectSharded()
+{
+	const auto SubjectsNum = PackedSubjects.Num();
+	const auto LayerSize = Size.X * Size.Y;
+
+	// Split the cage into the tiles, each time
+	// cutting the axis with the longest tiles...
+	FIntVector Tiles(1, 1, 1);
+	while (true)
+	{
+		int32 SplitAxis = INDEX_NONE;
+		float LongestExtent = 1.0f;
+		for (int32 Axis = 0; Axis < 3; ++Axis)
+		{
+			const auto Extent = (float)Size[Axis] / Tiles[Axis];
+			if (Extent > LongestExtent)
+			{
+				SplitAxis = Axis;
+				LongestExtent = Extent;
+			}
+		}
+		if (SplitAxis == INDEX_NONE) break;
+		auto NextTiles = Tiles;
+		NextTiles[SplitAxis] += 1;
+		if ((int64)NextTiles.X * NextTiles.Y * NextTiles.Z > ShardsCount) break;
+		Tiles = NextTiles;
+	}
+	const auto ShardsNum = Tiles.X * Tiles.Y * Tiles.Z;
+	const auto bContacts = IsGatheringContacts();
+	PairwiseDecouples.SetNum(1);
+	auto& Decouples = PairwiseDecouples[0];
+	Decouples.SetNumUninitialized(SubjectsNum);
+
+	const auto Subjects = PackedSubjects.GetData();
+	const auto LocationsX = PackedLocationsX.GetData();
+	const auto LocationsY = PackedLocationsY.GetData();
+	const auto LocationsZ = PackedLocationsZ.GetData();
+	const auto Radii = PackedRadii.GetData();
+	const auto DecoupleProportions = PackedDecoupleProportions.GetData();
+	const auto Layers = PackedLayers.GetData();
+	const auto Masks = PackedMasks.GetData();
+
+	// Use atomic for a thread safety:
+	std::atomic<float> AtomicMaxPenetration{0};
+
+	// Each of the shards writes the decouples of its own bubbles only,
+	// while the packed snapshot of its neighbours is just read...
+	ParallelFor(ShardsNum, [&](const int32 Shard)
+	{
+		float Penetration = 0.0f;
+		const FIntVector Tile(Shard % Tiles.X, (Shard / Tiles.X) % Tiles.Y, Shard / (Tiles.X * Tiles.Y));
+		FIntVector TileMin, TileMax;
+		for (int32 Axis = 0; Axis < 3; ++Axis)
+		{
+			TileMin[Axis] = (int32)(((int64)Size[Axis] * Tile[Axis]) / Tiles[Axis]);
+			TileMax[Axis] = (int32)(((int64)Size[Axis] * (Tile[Axis] + 1)) / Tiles[Axis]);
+		}
+		// The owned cells of each of the rows are contiguous,
+		// so are their subjects...
+		for (int32 TileZ = TileMin.Z; TileZ < TileMax.Z; ++TileZ)
+		{
+			for (int32 TileY = TileMin.Y; TileY < TileMax.Y; ++TileY)
+			{
+				const auto OwnedRowIndex = LayerSize * TileZ + Size.X * TileY;
+				for (int32 A = CellOffsets[OwnedRowIndex + TileMin.X]; A < CellOffsets[OwnedRowIndex + TileMax.X]; ++A)
+				{
+					auto& Decouple = Decouples[A];
+					Decouple = FVector4f(0, 0, 0, 0);
+					const auto ProportionA = DecoupleProportions[A];
+					if (UNLIKELY(!Subjects[A] || (ProportionA <= 0.0f))) continue;
+					const auto Location = FVector3f(LocationsX[A], LocationsY[A], LocationsZ[A]);
+					const auto Radius = Radii[A];
+					const auto Range = Radius + LargestRadius + DisplacementSlack;
+					const auto Center = GetSearchCenter(FVector(Location));
+					const auto Min = BoundedToCage(Center - FVector(Range));
+					const auto Max = BoundedToCage(Center + FVector(Range));
+					const auto MinX = FMath::Max(Min.X, 0);
+					const auto MaxX = FMath::Min(Max.X, Size.X - 1);
+					if (MinX > MaxX) continue;
+					for (int32 k = FMath::Max(Min.Z, 0); k <= FMath::Min(Max.Z, Size.Z - 1); ++k)
+					{
+						for (int32 j = FMath::Max(Min.Y, 0); j <= FMath::Min(Max.Y, Size.Y - 1); ++j)
+						{
+							// The cells of a row are contiguous,
+							// so are their subjects...
+							const auto RowIndex = LayerSize * k + Size.X * j;
+							FBubbleCageKernel::ForEachOverlapping(Location, Radius,
+																  LocationsX, LocationsY, LocationsZ, Radii,
+																  CellOffsets[RowIndex + MinX], CellOffsets[RowIndex + MaxX + 1],
+							[&](const int32 B)
+							{
+								if (UNLIKELY((B == A) || !Subjects[B])) return;
+								if (!(Layers[A] & Masks[B]) || !(Layers[B] & Masks[A])) return;
+								const auto ProportionB = DecoupleProportions[B];
+								const auto Delta = Location - FVector3f(LocationsX[B], LocationsY[B], LocationsZ[B]);
+								const auto Distance = FMath::Sqrt(Delta.SizeSquared());
+								const float DistanceDelta = Radius + Radii[B] - Distance;
+								Penetration = FMath::Max(Penetration, DistanceDelta);
+								// The pair is registered by a single of its bubbles,
+								// while the static ones do not detect anything...
+								if (bContacts && ((Subjects[A].GetId() < Subjects[B].GetId()) || (ProportionB <= 0.0f)))
+								{
+									AddContact(Subjects[A], Subjects[B]);
+								}
+								FVector3f Direction;
+								if (UNLIKELY(Distance <= SMALL_NUMBER))
+								{
+									// The distance is too small to get the direction.
+									// Use the ids to get the direction.
+									Direction = (Subjects[A].GetId() > Subjects[B].GetId()) ? FVector3f::LeftVector : FVector3f::RightVector;
+								}
+								else
+								{
+									Direction = Delta / Distance;
+								}
+								Decouple += FVector4f(Direction * (DistanceDelta * ProportionA / (ProportionA + ProportionB)), 1.0f);
+							});
+						}
+					}
+				}
+			}
+		}
+		AtomicMax(AtomicMaxPenetration, Penetration);
+	});
+	MaxPenetration = AtomicMaxPenetration.load(std::memory_order_relaxed);
+}
+
+template < bool bFiltered >
+int32
+UBubbleCageComponent::DoGetOverlappingBatch(TArrayView<const FVector> Locations,
+											TArrayView<const float>   Radii,
+											const FFilter&            Filter,
+											TArray<FSubjectHandle>&   OutOverlappers,
+											TArray<int32>&            OutOffsets) const
+{
+	const auto QueriesNum = Locations.Num();
+	OutOverlappers.Reset();
+	OutOffsets.SetNumUninitialized(QueriesNum + 1);
+	OutOffsets[QueriesNum] = 0;
+	if (!ensureAlwaysMsgf((Radii.Num() == 0) || (Radii.Num() == QueriesNum),
+						  TEXT("The number of radii (%d) doesn't match the number of locations (%d) queried within the '%s' bubble cage."),
+						  Radii.Num(), QueriesNum, *GetName()))
+	{
+		FMemory::Memzero(OutOffsets.GetData(), QueriesNum * sizeof(int32));
+		return 0;
+	}
+	if (QueriesNum == 0)
+	{
+		return 0;
+	}
+
+	// Sort the queries by their cells, so the neighbouring
+	// queries share the same cells within the caches.
+	// The scratch is local, so the batches may run concurrently...
+	TArray<TPair<uint64, int32>> BatchOrder;
+	BatchOrder.SetNumUninitialized(QueriesNum);
+	for (int32 Query = 0; Query < QueriesNum; ++Query)
+	{
+		const auto CellPoint = WorldToCage(Locations[Query]);
+		const auto X = (uint64)FMath::Clamp(CellPoint.X, 0, Size.X - 1);
+		const auto Y = (uint64)FMath::Clamp(CellPoint.Y, 0, Size.Y - 1);
+		const auto Z = (uint64)FMath::Clamp(CellPoint.Z, 0, Size.Z - 1);
+		const auto Key = (bMortonCells && !bSparseCells)
+					   ? (uint64)GetLayoutIndex(Size, (int32)X, (int32)Y, (int32)Z)
+					   : X + (uint64)Size.X * (Y + (uint64)Size.Y * Z);
+		BatchOrder[Query] = TPair<uint64, int32>(Key, Query);
+	}
+	BatchOrder.Sort([](const TPair<uint64, int32>& A, const TPair<uint64, int32>& B)
+	{
+		return A.Key < B.Key;
+	});
+
+	// Each of the chunks gathers its own results.
+	// The counts are stored within the offsets for now...
+	const auto ChunksNum = FMath::Min(FMath::Max(1, ThreadsCount), QueriesNum);
+	TArray<TArray<FSubjectHandle>> BatchBuffers;
+	BatchBuffers.SetNum(ChunksNum);
+	TArray<int32> BatchStarts;
+	BatchStarts.SetNumUninitialized(QueriesNum);
+	ParallelFor(ChunksNum, [&](const int32 Chunk)
+	{
+		auto& Buffer = BatchBuffers[Chunk];
+		const auto Begin = (int32)(((int64)QueriesNum * Chunk) / ChunksNum);
+		const auto End = (int32)(((int64)QueriesNum * (Chunk + 1)) / ChunksNum);
+		for (int32 i = Begin; i < End; ++i)
+		{
+			const auto Query = BatchOrder[i].Value;
+			const auto& Location = Locations[Query];
+			const auto Radius = (Radii.Num() > 0) ? Radii[Query] : 0.0f;
+			BatchStarts[Query] = Buffer.Num();
+			DoForEachOverlapping<bFiltered>(Location, Radius, &Filter, AllLayers,
+			[&](const FSubjectHandle& Subject, const FVector&, const float, const float)
+			{
+				Buffer.Add(Subject);
+			});
+			OutOffsets[Query] = Buffer.Num() - BatchStarts[Query];
+		}
+	});
+
+	// Turn the counts into the offsets...
+	int32 Total = 0;
+	for (int32 Query = 0; Query < QueriesNum; ++Query)
+	{
+		const auto Count = OutOffsets[Query];
+		OutOffsets[Query] = Total;
+		Total += Count;
+	}
+	OutOffsets[QueriesNum] = Total;
+
+	// Gather the results within the flat buffer...
+	OutOverlappers.SetNumUninitialized(Total);
+	ParallelFor(ChunksNum, [&](const int32 Chunk)
+	{
+		const auto& Buffer = BatchBuffers[Chunk];
+		const auto Begin = (int32)(((int64)QueriesNum * Chunk) / ChunksNum);
+		const auto End = (int32)(((int64)QueriesNum * (Chunk + 1)) / ChunksNum);
+		for (int32 i = Begin; i < End; ++i)
+		{
+			const auto Query = BatchOrder[i].Value;
+			auto Source = BatchStarts[Query];
+			const auto TargetEnd = OutOffsets[Query + 1];
+			for (int32 Target = OutOffsets[Query]; Target < TargetEnd; ++Target, ++Source)
+			{
+				OutOverlappers[Target] = Buffer[Source];
+			}
+		}
+	});
+	return Total;
+}
+
+int32
+UBubbleCageComponent::GetOverlappingBatch(TArrayView<const FVector> Locations,
+										  TArrayView<const float>   Radii,
+										  TArray<FSubjectHandle>&   OutOverlappers,
+										  TArray<int32>&            OutOffsets) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BubbleCage_GetOverlappingBatch);
+	return DoGetOverlappingBatch<false>(Locations, Radii, FFilter(), OutOverlappers, OutOffsets);
+}
+
+int32
+UBubbleCageComponent::GetOverlappingBatch(TArrayView<const FVector> Locations,
+										  TArrayView<const float>   Radii,
+										  const FFilter&            Filter,
+										  TArray<FSubjectHandle>&   OutOverlappers,
+										  TArray<int32>&            OutOffsets) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BubbleCage_GetOverlappingBatch);
+	return DoGetOverlappingBatch<true>(Locations, Radii, Filter, OutOverlappers, OutOffsets);
+}
+
+template < bool bFiltered >
+bool
+UBubbleCageComponent::DoSphereCast(const FVector&          Start,
+								   const FVector&          End,
+								   const float             Radius,
+								   const FFilter*          Filter,
+								   const uint32            LayerMask,
+								   FBubbleCageHit*         OutHit,
+								   TArray<FBubbleCageHit>* OutHits) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BubbleCage_SphereCast);
+
+	if (OutHits != nullptr)
+	{
+		OutHits->Reset();
+	}
+
+	const auto LocalStart = FVector3f(WorldToBounded(Start));
+	auto Direction = FVector3f(End - Start);
+	const auto Length = Direction.Size();
+	if (Length > SMALL_NUMBER)
+	{
+		Direction /= Length;
+	}
+	else
+	{
+		// Only the overlaps at the start are possible...
+		Direction = FVector3f::ForwardVector;
+	}
+
+	auto ClosestDistance = Length;
+	bool bHit = false;
+	const auto TestOccupant = [&](const FOccupant& Occupant)
+	{
+		if (UNLIKELY(!MatchesOccupant<bFiltered>(Occupant, Filter, LayerMask))) return;
+		const auto Reach = Radius + Occupant.Radius;
+		const auto Offset = LocalStart - Occupant.Location;
+		const auto Projection = Offset | Direction;
+		const auto Excess = Offset.SizeSquared() - Reach * Reach;
+		float Distance = 0;
+		if (Excess > 0)
+		{
+			// Not overlapping at the start...
+			if (Projection >= 0) return; // Moving away.
+			const auto Discriminant = Projection * Projection - Excess;
+			if (Discriminant < 0) return;
+			Distance = -Projection - FMath::Sqrt(Discriminant);
+		}
+		if (Distance > ClosestDistance) return;
+
+		FBubbleCageHit Hit;
+		Hit.Subject = Occupant.Subject;
+		Hit.Distance = Distance;
+		Hit.Location = Start + FVector(Direction * Distance);
+		Hit.Normal = FVector((Offset + Direction * Distance).GetSafeNormal());
+		if (OutHits != nullptr)
+		{
+			OutHits->Add(Hit);
+		}
+		else
+		{
+			*OutHit = Hit;
+			ClosestDistance = Distance;
+		}
+		bHit = true;
+	};
+
+	for (int32 Level = 0; Level < LevelLargestRadii.Num(); ++Level)
+	{
+		const auto LevelLargestRadius = LevelLargestRadii[Level];
+		if (LevelLargestRadius < 0) continue; // The level is empty.
+		ForEachCellAlong(Level, LocalStart, Direction, Length, Radius + LevelLargestRadius + DisplacementSlack,
+		[&](const int32 CellIndex, const float Distance)
+		{
+			// Nothing closer can be hit from now on,
+			// except for the overflowing border bubbles...
+			if (Distance > ClosestDistance) return BoundsPolicy == EBubbleCageBoundsPolicy::Overflow;
+			if (!MatchesCell<bFiltered>(CellIndex, Filter, LayerMask)) return true;
+			ForEachOccupantIn(CellIndex, TestOccupant);
+			return true;
+		});
+	}
+
+	if (OutHits != nullptr)
+	{
+		OutHits->Sort([](const FBubbleCageHit& A, const FBubbleCageHit& B)
+		{
+			return A.Distance < B.Distance;
+		});
+	}
+	return bHit;
+}
+
+template bool UBubbleCageComponent::DoSphereCast<false>(const FVector&, const FVector&, const float, const FFilter*, const uint32, FBubbleCageHit*, TArray<FBubbleCageHit>*) const;
+template bool UBubbleCageComponent::DoSphereCast<true>(const FVector&, const FVector&, const float, const FFilter*, const uint32, FBubbleCageHit*, TArray<FBubbleCageHit>*) const;
+
+template < bool bFiltered >
+int32
+UBubbleCageComponent::DoGetNearest(const FVector&  Location,
+								   const int32     K,
+								   const FFilter*  Filter,
+								   const uint32    LayerMask,
+								   const float     MaxRadius,
+								   FSubjectHandle* OutNearest) const
+{
+	if (UNLIKELY(K <= 0)) return 0;
+
+	// The bounded max-heap of the nearest bubbles found so far...
+	using FCandidate = TPair<float, FSubjectHandle>;
+	const auto FartherFirst = [](const FCandidate& A, const FCandidate& B)
+	{
+		return A.Key > B.Key;
+	};
+	TArray<FCandidate, TInlineAllocator<32>> Heap;
+	const auto MaxDistanceSquared = FMath::Square(MaxRadius);
+
+	// Each of the cells is visited at most once,
+	// so stop as soon as all of the occupants are seen...
+	auto UnseenNum = GetOccupantsNum();
+	const auto LocalLocation = FVector3f(WorldToBounded(Location));
+	for (int32 Level = 0; (Level < LevelLargestRadii.Num()) && (UnseenNum > 0); ++Level)
+	{
+		if (LevelLargestRadii[Level] < 0) continue; // The level is empty.
+		const auto LevelCellSize = CellSize * (1 << Level);
+		const auto LevelSize = GetLevelSize(Level);
+		// The overflowing bubbles are binned by their nearest
+		// points of the bounds, so are the shells centered...
+		const auto CagePoint = BoundedToCage(GetSearchCenter(WorldToBounded(Location)));
+		auto Center = FIntVector(CagePoint.X >> Level, CagePoint.Y >> Level, CagePoint.Z >> Level);
+		if (bPlanar)
+		{
+			// The only layer holds all the heights,
+			// while the planar distance is still a lower bound...
+			Center.Z = 0;
+		}
+		const auto ShellsNum = FMath::Max3(FMath::Max(FMath::Abs(Center.X), FMath::Abs(LevelSize.X - 1 - Center.X)),
+										   FMath::Max(FMath::Abs(Center.Y), FMath::Abs(LevelSize.Y - 1 - Center.Y)),
+										   FMath::Max(FMath::Abs(Center.Z), FMath::Abs(LevelSize.Z - 1 - Center.Z)));
+
+		const auto VisitCellIndex = [&](const int32 CellIndex)
+		{
+			UnseenNum -= GetCellOccupantsNum(CellIndex);
+			if (!MatchesCell<bFiltered>(CellIndex, Filter, LayerMask)) return;
+			ForEachOccupantIn(CellIndex, [&](const FOccupant& Occupant)
+			{
+				if (UNLIKELY(!MatchesOccupant<bFiltered>(Occupant, Filter, LayerMask))) return;
+				const auto DistanceSquared = (LocalLocation - Occupant.Location).SizeSquared();
+				if (DistanceSquared > MaxDistanceSquared) return;
+				if (Heap.Num() < K)
+				{
+					Heap.HeapPush(FCandidate(DistanceSquared, Occupant.Subject), FartherFirst);
+				}
+				else if (DistanceSquared < Heap.HeapTop().Key)
+				{
+					Heap.HeapPopDiscard(FartherFirst, /*bAllowShrinking=*/false);
+					Heap.HeapPush(FCandidate(DistanceSquared, Occupant.Subject), FartherFirst);
+				}
+			});
+		};
+		const auto VisitCell = [&](const FIntVector& CellPoint)
+		{
+			const auto CellIndex = FindCellIndex(CellPoint, Level);
+			if (CellIndex == INDEX_NONE) return;
+			VisitCellIndex(CellIndex);
+		};
+
+		for (int32 Shell = 0; Shell <= ShellsNum; ++Shell)
+		{
+			// The bubbles of the shell are at least this far away,
+			// while they may have drifted from their cells...
+			const auto Bound = FMath::Max(0.0f, (Shell - 1) * LevelCellSize - DisplacementSlack);
+			if (Bound > MaxRadius) break;
+			if ((Heap.Num() == K) && (FMath::Square(Bound) >= Heap.HeapTop().Key)) break;
+			if (UnseenNum <= 0) break;
+
+			const auto Side = (int64)(2 * Shell + 1);
+			if (bSparseCells && (Side * Side * (bPlanar ? 1 : Side) > (int64)SparseCellsNum.load(std::memory_order_relaxed)))
+			{
+				// The shells outgrew the occupied cells,
+				// so scan the rest of those at once instead...
+				for (int32 Slot = 0; Slot < SparseKeys.Num(); ++Slot)
+				{
+					if (SparseKeys[Slot] == EmptySparseKey) continue;
+					int32 SlotLevel;
+					const auto Offset = GetCellPoint(Slot, SlotLevel) - Center;
+					if (SlotLevel != Level) continue;
+					if (FMath::Max3(FMath::Abs(Offset.X), FMath::Abs(Offset.Y), FMath::Abs(Offset.Z)) < Shell) continue;
+					VisitCellIndex(Slot);
+				}
+				break;
+			}
+
+			// Iterate the surface of the shell's cube only...
+			for (int32 i = -Shell; i <= Shell; ++i)
+			{
+				for (int32 j = -Shell; j <= Shell; ++j)
+				{
+					if ((FMath::Abs(i) == Shell) || (FMath::Abs(j) == Shell))
+					{
+						for (int32 k = -Shell; k <= Shell; ++k)
+						{
+							VisitCell(Center + FIntVector(i, j, k));
+						}
+					}
+					else
+					{
+						VisitCell(Center + FIntVector(i, j, -Shell));
+						if (Shell > 0)
+						{
+							VisitCell(Center + FIntVector(i, j, Shell));
+						}
+					}
+				}
+			}
+		}
+	}
+
+	Heap.Sort([](const FCandidate& A, const FCandidate& B)
+	{
+		return A.Key < B.Key;
+	});
+	for (int32 i = 0; i < Heap.Num(); ++i)
+	{
+		OutNearest[i] = Heap[i].Value;
+	}
+	return Heap.Num();
+}
+
+template < bool bFiltered >
+int32
+UBubbleCageComponent::DoGetNearestBatch(TArrayView<const FVector> Locations,
+										const int32               K,
+										const FFilter*            Filter,
+										const uint32              LayerMask,
+										const float               MaxRadius,
+										TArray<FSubjectHandle>&   OutNearest,
+										TArray<int32>&            OutOffsets) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BubbleCage_GetNearestBatch);
+
+	const auto QueriesNum = Locations.Num();
+	const auto Stride = FMath::Max(K, 0);
+	OutOffsets.SetNumUninitialized(QueriesNum + 1);
+	OutNearest.SetNumUninitialized(QueriesNum * Stride);
+
+	// Each of the queries gets its own fixed slot for now,
+	// while the counts are stored within the offsets...
+	const auto ChunksNum = FMath::Max(1, FMath::Min(ThreadsCount, QueriesNum));
+	ParallelFor(ChunksNum, [&](const int32 Chunk)
+	{
+		const auto Begin = (int32)(((int64)QueriesNum * Chunk) / ChunksNum);
+		const auto End = (int32)(((int64)QueriesNum * (Chunk + 1)) / ChunksNum);
+		for (int32 Query = Begin; Query < End; ++Query)
+		{
+			OutOffsets[Query] = DoGetNearest<bFiltered>(Locations[Query], K, Filter, LayerMask, MaxRadius,
+														OutNearest.GetData() + Query * Stride);
+		}
+	});
+
+	// Compact the slots, turning the counts into the offsets...
+	int32 Total = 0;
+	for (int32 Query = 0; Query < QueriesNum; ++Query)
+	{
+		const auto Count = OutOffsets[Query];
+		const auto Source = Query * Stride;
+		for (int32 i = 0; i < Count; ++i)
+		{
+			OutNearest[Total + i] = OutNearest[Source + i];
+		}
+		OutOffsets[Query] = Total;
+		Total += Count;
+	}
+	OutOffsets[QueriesNum] = Total;
+	OutNearest.SetNum(Total);
+	return Total;
+}
+
+template int32 UBubbleCageComponent::DoGetNearest<false>(const FVector&, const int32, const FFilter*, const uint32, const float, FSubjectHandle*) const;
+template int32 UBubbleCageComponent::DoGetNearest<true>(const FVector&, const int32, const FFilter*, const uint32, const float, FSubjectHandle*) const;
+template int32 UBubbleCageComponent::DoGetNearestBatch<false>(TArrayView<const FVector>, const int32, const FFilter*, const uint32, const float, TArray<FSubjectHandle>&, TArray<int32>&) const;
+template int32 UBubbleCageComponent::DoGetNearestBatch<true>(TArrayView<const FVector>, const int32, const FFilter*, const uint32, const float, TArray<FSubjectHandle>&, TArray<int32>&) const;
+
+template < bool bFiltered, typename RegionT >
+int32
+UBubbleCageComponent::DoGetOverlappingRegion(const RegionT&          Region,
+											 const FFilter*          Filter,
+											 TArray<FSubjectHandle>& OutOverlappers) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BubbleCage_GetOverlappingRegion);
+
+	OutOverlappers.Reset();
+
+	const auto MatchesCell = [&](const int32 CellIndex)
+	{
+		if (bFiltered) // Compile-time branch.
+		{
+			// Negative filtering can't be performed here,
+			// since the cell's fingerprint includes a sum of internals.
+			return GetCellFingerprint(CellIndex).Matches(Filter->GetFingerprint());
+		}
+		return true;
+	};
+	const auto MatchesSubject = [&](const FSubjectHandle& Subject)
+	{
+		return bFiltered ? Subject.Matches(*Filter) : (bool)Subject;
+	};
+
+	for (int32 Level = 0; Level < LevelLargestRadii.Num(); ++Level)
+	{
+		const auto LevelLargestRadius = LevelLargestRadii[Level];
+		if (LevelLargestRadius < 0) continue; // The level is empty.
+		const auto LevelCellSize = CellSize * (1 << Level);
+		const auto LevelSize = GetLevelSize(Level);
+
+		// The centers of the bubbles may have drifted from their cells,
+		// while the bubbles themselves may stick out of them...
+		const auto GetBlockBox = [&](const FIntVector& Min, const FIntVector& Max, const float Inflation)
+		{
+			FBox Box(Bounds.Min + FVector(Min) * LevelCellSize - FVector(Inflation),
+					 Bounds.Min + FVector(Max + FIntVector(1)) * LevelCellSize + FVector(Inflation));
+			if (bPlanar)
+			{
+				// The planar cells span all the heights,
+				// while the bubbles are only within these...
+				Box.Min.Z = Bounds.Min.Z + LowestHeight - Inflation;
+				Box.Max.Z = Bounds.Min.Z + HighestHeight + Inflation;
+			}
+			if (BoundsPolicy == EBubbleCageBoundsPolicy::Overflow)
+			{
+				// The border cells also hold the bubbles outside,
+				// so those blocks never get emitted in bulk.
+				// The planar heights are never overflown...
+				for (int32 Axis = 0; Axis < (bPlanar ? 2 : 3); ++Axis)
+				{
+					if (Min[Axis] <= 0)
+					{
+						Box.Min[Axis] = -BIG_NUMBER;
+					}
+					if (Max[Axis] >= LevelSize[Axis] - 1)
+					{
+						Box.Max[Axis] = BIG_NUMBER;
+					}
+				}
+			}
+			return Box;
+		};
+
+		const auto ForEachCellIn = [&](const FIntVector& Min, const FIntVector& Max, auto&& Functor)
+		{
+			for (auto i = Min.X; i <= Max.X; ++i)
+			{
+				for (auto j = Min.Y; j <= Max.Y; ++j)
+				{
+					for (auto k = Min.Z; k <= Max.Z; ++k)
+					{
+						const auto CellIndex = FindCellIndex(FIntVector(i, j, k), Level);
+						if ((CellIndex != INDEX_NONE) && MatchesCell(CellIndex))
+						{
+							Functor(CellIndex);
+						}
+					}
+				}
+			}
+		};
+
+		// Subdivide the level into the blocks of cells...
+		TArray<TPair<FIntVector, FIntVector>, TInlineAllocator<64>> Blocks;
+		Blocks.Emplace(FIntVector::ZeroValue, LevelSize - FIntVector(1));
+		while (Blocks.Num() > 0)
+		{
+			const auto Block = Blocks.Pop(/*bAllowShrinking=*/false);
+			const auto& Min = Block.Key;
+			const auto& Max = Block.Value;
+			if (!Region.Intersects(GetBlockBox(Min, Max, LevelLargestRadius + DisplacementSlack)))
+			{
+				continue;
+			}
+			if (Region.Contains(GetBlockBox(Min, Max, DisplacementSlack)))
+			{
+				// All of the bubbles are overlapping...
+				ForEachCellIn(Min, Max, [&](const int32 CellIndex)
+				{
+					ForEachOccupantIn(CellIndex, [&](const FOccupant& Occupant)
+					{
+						if (LIKELY(MatchesSubject(Occupant.Subject)))
+						{
+							OutOverlappers.Add(Occupant.Subject);
+						}
+					});
+				});
+				continue;
+			}
+			const auto Extent = Max - Min;
+			if ((Extent.X == 0) && (Extent.Y == 0) && (Extent.Z == 0))
+			{
+				// A single straddling cell, so test each of the bubbles...
+				ForEachCellIn(Min, Max, [&](const int32 CellIndex)
+				{
+					ForEachOccupantIn(CellIndex, [&](const FOccupant& Occupant)
+					{
+						if (Region.Overlaps(BoundedToWorld(Occupant.Location), Occupant.Radius) &&
+							LIKELY(MatchesSubject(Occupant.Subject)))
+						{
+							OutOverlappers.Add(Occupant.Subject);
+						}
+					});
+				});
+				continue;
+			}
+			// Split the block along its longest axis...
+			const auto Axis = (Extent.X >= Extent.Y) ? ((Extent.X >= Extent.Z) ? 0 : 2)
+													 : ((Extent.Y >= Extent.Z) ? 1 : 2);
+			const auto Middle = Min[Axis] + Extent[Axis] / 2;
+			auto LowerMax = Max;
+			LowerMax[Axis] = Middle;
+			auto UpperMin = Min;
+			UpperMin[Axis] = Middle + 1;
+			Blocks.Emplace(Min, LowerMax);
+			Blocks.Emplace(UpperMin, Max);
+		}
+	}
+	return OutOverlappers.Num();
+}
+
+int32
+UBubbleCageComponent::GetOverlappingBox(const FBox&             Box,
+										TArray<FSubjectHandle>& OutOverlappers) const
+{
+	return DoGetOverlappingRegion<false>(FBubbleCageBoxRegion{Box}, nullptr, OutOverlappers);
+}
+
+int32
+UBubbleCageComponent::GetOverlappingBox(const FBox&             Box,
+										const FFilter&          Filter,
+										TArray<FSubjectHandle>& OutOverlappers) const
+{
+	return DoGetOverlappingRegion<true>(FBubbleCageBoxRegion{Box}, &Filter, OutOverlappers);
+}
+
+int32
+UBubbleCageComponent::GetOverlappingOrientedBox(const FVector&          Center,
+												const FVector&          Extent,
+												const FQuat&            Rotation,
+												TArray<FSubjectHandle>& OutOverlappers) const
+{
+	return DoGetOverlappingRegion<false>(FBubbleCageOrientedBoxRegion{Center, Extent, Rotation}, nullptr, OutOverlappers);
+}
+
+int32
+UBubbleCageComponent::GetOverlappingOrientedBox(const FVector&          Center,
+												const FVector&          Extent,
+												const FQuat&            Rotation,
+												const FFilter&          Filter,
+												TArray<FSubjectHandle>& OutOverlappers) const
+{
+	return DoGetOverlappingRegion<true>(FBubbleCageOrientedBoxRegion{Center, Extent, Rotation}, &Filter, OutOverlappers);
+}
+
+int32
+UBubbleCageComponent::GetOverlappingConvex(const FConvexVolume&    Volume,
+										   TArray<FSubjectHandle>& OutOverlappers) const
+{
+	return DoGetOverlappingRegion<false>(FBubbleCageConvexRegion{Volume}, nullptr, OutOverlappers);
+}
+
+int32
+UBubbleCageComponent::GetOverlappingConvex(const FConvexVolume&    Volume,
+										   const FFilter&          Filter,
+										   TArray<FSubjectHandle>& OutOverlappers) const
+{
+	return DoGetOverlappingRegion<true>(FBubbleCageConvexRegion{Volume}, &Filter, OutOverlappers);
+}
@@ -188,6 +188,222 @@ class APPARATISTRUNTIME_API ABubbleCage
 		return 0;
 	}
 
+	/**
+	 * Get overlapping spheres belonging to any of the collision layers.
+	 */
+	UFUNCTION(BlueprintCallable)
+	static int32
+	GetOverlappingInLayers(const FVector&          Location,
+						   const float             Radius,
+						   UPARAM(Meta = (Bitmask)) const int32 LayerMask,
+						   TArray<FSubjectHandle>& OutOverlappers)
+	{
+		if (LIKELY(Instance != nullptr && Instance->BubbleCageComponent != nullptr))
+		{
+			return Instance->BubbleCageComponent->GetOverlappingInLayers(Location, Radius, LayerMask, OutOverlappers);
+		}
+		OutOverlappers.Reset();
+		return 0;
+	}
+
+	/**
+	 * Iterate the bubbles overlapping a sphere.
+	 * 
+	 * @see UBubbleCageComponent::ForEachOverlapping()
+	 */
+	template < typename FunctorT >
+	static FORCEINLINE bool
+	ForEachOverlapping(const FVector& Location,
+					   const float    Radius,
+					   FunctorT&&     Functor)
+	{
+		if (LIKELY(Instance != nullptr && Instance->BubbleCageComponent != nullptr))
+		{
+			return Instance->BubbleCageComponent->ForEachOverlapping(Location, Radius, Forward<FunctorT>(Functor));
+		}
+		return true;
+	}
+
+	/**
+	 * Iterate the bubbles overlapping a sphere and matching a filter.
+	 * 
+	 * @see UBubbleCageComponent::ForEachOverlapping()
+	 */
+	template < typename FunctorT >
+	static FORCEINLINE bool
+	ForEachOverlapping(const FVector& Location,
+					   const float    Radius,
+					   const FFilter& Filter,
+					   FunctorT&&     Functor)
+	{
+		if (LIKELY(Instance != nullptr && Instance->BubbleCageComponent != nullptr))
+		{
+			return Instance->BubbleCageComponent->ForEachOverlapping(Location, Radius, Filter, Forward<FunctorT>(Functor));
+		}
+		return true;
+	}
+
+	/**
+	 * Iterate the bubbles overlapping a sphere
+	 * and belonging to any of the collision layers.
+	 * 
+	 * @see UBubbleCageComponent::ForEachOverlapping()
+	 */
+	template < typename FunctorT >
+	static FORCEINLINE bool
+	ForEachOverlapping(const FVector& Location,
+					   const float    Radius,
+					   const int32    LayerMask,
+					   FunctorT&&     Functor)
+	{
+		if (LIKELY(Instance != nullptr && Instance->BubbleCageComponent != nullptr))
+		{
+			return Instance->BubbleCageComponent->ForEachOverlapping(Location, Radius, LayerMask, Forward<FunctorT>(Functor));
+		}
+		return true;
+	}
+
+	/**
+	 * Get the bubbles overlapping an axis-aligned box.
+	 */
+	static int32
+	GetOverlappingBox(const FBox&             Box,
+					  TArray<FSubjectHandle>& OutOverlappers)
+	{
+		if (LIKELY(Instance != nullptr && Instance->BubbleCageComponent != nullptr))
+		{
+			return Instance->BubbleCageComponent->GetOverlappingBox(Box, OutOverlappers);
+		}
+		OutOverlappers.Reset();
+		return 0;
+	}
+
+	/**
+	 * Get the bubbles overlapping an axis-aligned box and matching a filter.
+	 */
+	static int32
+	GetOverlappingBox(const FBox&             Box,
+					  const FFilter&          Filter,
+					  TArray<FSubjectHandle>& OutOverlappers)
+	{
+		if (LIKELY(Instance != nullptr && Instance->BubbleCageComponent != nullptr))
+		{
+			return Instance->BubbleCageComponent->GetOverlappingBox(Box, Filter, OutOverlappers);
+		}
+		OutOverlappers.Reset();
+		return 0;
+	}
+
+	/**
+	 * Get the bubbles overlapping an oriented box.
+	 */
+	static int32
+	GetOverlappingOrientedBox(const FVector&          Center,
+							  const FVector&          Extent,
+							  const FQuat&            Rotation,
+							  TArray<FSubjectHandle>& OutOverlappers)
+	{
+		if (LIKELY(Instance != nullptr && Instance->BubbleCageComponent != nullptr))
+		{
+			return Instance->BubbleCageComponent->GetOverlappingOrientedBox(Center, Extent, Rotation, OutOverlappers);
+		}
+		OutOverlappers.Reset();
+		return 0;
+	}
+
+	/**
+	 * Get the bubbles overlapping an oriented box and matching a filter.
+	 */
+	static int32
+	GetOverlappingOrientedBox(const FVector&          Center,
+							  const FVector&          Extent,
+							  const FQuat&            Rotation,
+							  const FFilter&          Filter,
+							  TArray<FSubjectHandle>& OutOverlappers)
+	{
+		if (LIKELY(Instance != nullptr && Instance->BubbleCageComponent != nullptr))
+		{
+			return Instance->BubbleCageComponent->GetOverlappingOrientedBox(Center, Extent, Rotation, Filter, OutOverlappers);
+		}
+		OutOverlappers.Reset();
+		return 0;
+	}
+
+	/**
+	 * Get the bubbles overlapping a convex volume, like a view frustum.
+	 */
+	static int32
+	GetOverlappingConvex(const FConvexVolume&    Volume,
+						 TArray<FSubjectHandle>& OutOverlappers)
+	{
+		if (LIKELY(Instance != nullptr && Instance->BubbleCageComponent != nullptr))
+		{
+			return Instance->BubbleCageComponent->GetOverlappingConvex(Volume, OutOverlappers);
+		}
+		OutOverlappers.Reset();
+		return 0;
+	}
+
+	/**
+	 * Get the bubbles overlapping a convex volume and matching a filter.
+	 */
+	static int32
+	GetOverlappingConvex(const FConvexVolume&    Volume,
+						 const FFilter&          Filter,
+						 TArray<FSubjectHandle>& OutOverlappers)
+	{
+		if (LIKELY(Instance != nullptr && Instance->BubbleCageComponent != nullptr))
+		{
+			return Instance->BubbleCageComponent->GetOverlappingConvex(Volume, Filter, OutOverlappers);
+		}
+		OutOverlappers.Reset();
+		return 0;
+	}
+
+	/**
+	 * Get overlapping spheres for a batch of locations at once.
+	 * 
+	 * The overlappers of the i-th query are stored within
+	 * the [OutOffsets[i], OutOffsets[i + 1]) range.
+	 */
+	static int32
+	GetOverlappingBatch(TArrayView<const FVector> Locations,
+						TArrayView<const float>   Radii,
+						TArray<FSubjectHandle>&   OutOverlappers,
+						TArray<int32>&            OutOffsets)
+	{
+		if (LIKELY(Instance != nullptr && Instance->BubbleCageComponent != nullptr))
+		{
+			return Instance->BubbleCageComponent->GetOverlappingBatch(Locations, Radii, OutOverlappers, OutOffsets);
+		}
+		OutOverlappers.Reset();
+		OutOffsets.Init(0, Locations.Num() + 1);
+		return 0;
+	}
+
+	/**
+	 * Get overlapping spheres for a batch of locations at once
+	 * narrowing them by a filter.
+	 * 
+	 * The overlappers of the i-th query are stored within
+	 * the [OutOffsets[i], OutOffsets[i + 1]) range.
+	 */
+	static int32
+	GetOverlappingBatch(TArrayView<const FVector> Locations,
+						TArrayView<const float>   Radii,
+						const FFilter&            Filter,
+						TArray<FSubjectHandle>&   OutOverlappers,
+						TArray<int32>&            OutOffsets)
+	{
+		if (LIKELY(Instance != nullptr && Instance->BubbleCageComponent != nullptr))
+		{
+			return Instance->BubbleCageComponent->GetOverlappingBatch(Locations, Radii, Filter, OutOverlappers, OutOffsets);
+		}
+		OutOverlappers.Reset();
+		OutOffsets.Init(0, Locations.Num() + 1);
+		return 0;
+	}
+
 	/**
 	 * Re-fill the cage with bubbles.
 	 */
@@ -210,6 +426,19 @@ class APPARATISTRUNTIME_API ABubbleCage
 		Instance->BubbleCageComponent->Decouple();
 	}
 
+	/**
+	 * Re-register and iteratively decouple the bubbles.
+	 * 
+	 * @return The number of the decoupling passes actually performed.
+	 */
+	UFUNCTION(BlueprintCallable)
+	static int32
+	Solve()
+	{
+		if (UNLIKELY(Instance == nullptr)) return 0;
+		return Instance->BubbleCageComponent->Solve();
+	}
+
 	/**
 	 * Re-register and decouple the bubbles.
 	 */
@@ -220,4 +449,29 @@ class APPARATISTRUNTIME_API ABubbleCage
 		if (UNLIKELY(Instance == nullptr)) return;
 		Instance->BubbleCageComponent->Evaluate();
 	}
+
+	/**
+	 * Re-register and decouple the bubbles
+	 * on a background thread.
+	 * 
+	 * @return The event fired once the evaluation is complete.
+	 * Invalid, if there is no cage.
+	 */
+	static FGraphEventRef
+	EvaluateAsync()
+	{
+		if (UNLIKELY(Instance == nullptr)) return FGraphEventRef();
+		return Instance->BubbleCageComponent->EvaluateAsync();
+	}
+
+	/**
+	 * Wait for the pending asynchronous evaluation to complete.
+	 */
+	UFUNCTION(BlueprintCallable)
+	static void
+	WaitForEvaluation()
+	{
+		if (UNLIKELY(Instance == nullptr)) return;
+		Instance->BubbleCageComponent->WaitForEvaluation();
+	}
 };
@@ -24,6 +24,27 @@
 #include "BubbleCageCell.generated.h"
 
 
+/**
+ * A snapshot of a bubble within a cell.
+ */
+struct APPARATISTRUNTIME_API FBubbleCageOccupant
+{
+	/// The cage-local location of the bubble.
+	FVector3f Location = FVector3f::ZeroVector;
+
+	/// The radius of the bubble.
+	float Radius = 0;
+
+	/// The decoupling strength of the bubble.
+	float DecoupleProportion = 0;
+
+	/// The collision layers of the bubble.
+	uint32 Layers = 0;
+
+	/// The collision mask of the bubble.
+	uint32 Mask = 0;
+};
+
 /**
  * Struct representing a one grid cell.
  */
@@ -65,6 +86,73 @@ struct APPARATISTRUNTIME_API FBubbleCageCell
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "BubbleCage")
 	FFingerprint Fingerprint;
 
+	/**
+	 * The accumulated collision layers of all subjects within this cell.
+	 * 
+	 * Just like the fingerprint, this can be more inclusive than actually is.
+	 */
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "BubbleCage")
+	int32 Layers = 0;
+
+	/**
+	 * The snapshots of the subjects' bubbles.
+	 * 
+	 * Kept parallel to the subjects, so the neighbours
+	 * are tested without fetching their traits.
+	 */
+	TArray<FBubbleCageOccupant, TInlineAllocator<8>> Occupants;
+
+	/**
+	 * Add a subject along with the snapshot of its bubble.
+	 * 
+	 * @return The index of the subject within the cell.
+	 */
+	int32
+	Add(const FSubjectHandle& Subject, const FBubbleCageOccupant& Occupant)
+	{
+		const auto Index = Subjects.Add(Subject);
+		Occupants.SetNum(Subjects.Num(), /*bAllowShrinking=*/false);
+		Occupants[Index] = Occupant;
+		return Index;
+	}
+
+	/**
+	 * Remove a subject along with its snapshot.
+	 * 
+	 * The last subject takes the place of the removed one.
+	 */
+	void
+	RemoveAt(const int32 Index)
+	{
+		const auto Last = Subjects.Num() - 1;
+		if (Index != Last)
+		{
+			Swap(Subjects[Index], Subjects[Last]);
+			Swap(Occupants[Index], Occupants[Last]);
+		}
+		// The despawned subjects are all equal,
+		// so the removal has to be positional...
+		FSubjectHandles8 Kept;
+		for (int32 t = 0; t < Last; ++t)
+		{
+			Kept.Add(Subjects[t]);
+		}
+		Subjects = Kept;
+		Occupants.SetNum(Last, /*bAllowShrinking=*/false);
+	}
+
+	/**
+	 * Remove all of the subjects.
+	 */
+	void
+	Reset()
+	{
+		Subjects.Empty();
+		Occupants.Reset();
+		Fingerprint.Reset();
+		Layers = 0;
+	}
+
 	FBubbleCageCell()
 	{}
 
@@ -73,6 +161,8 @@ struct APPARATISTRUNTIME_API FBubbleCageCell
 		LockFlag.store(Cell.LockFlag.load());
 		Subjects = Cell.Subjects;
 		Fingerprint = Cell.Fingerprint;
+		Layers = Cell.Layers;
+		Occupants = Cell.Occupants;
 	}
 
 	FBubbleCageCell& operator=(const FBubbleCageCell& Cell)
@@ -80,6 +170,8 @@ struct APPARATISTRUNTIME_API FBubbleCageCell
 		LockFlag.store(Cell.LockFlag.load());
 		Subjects = Cell.Subjects;
 		Fingerprint = Cell.Fingerprint;
+		Layers = Cell.Layers;
+		Occupants = Cell.Occupants;
 		return *this;
 	}
 };
@@ -16,15 +16,21 @@
 
 #include <atomic>
 
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
 #include "Containers/UnrealString.h"
 #include "CoreMinimal.h"
 #include "DrawDebugHelpers.h"
 #include "GameFramework/Actor.h"
 #include "Containers/Queue.h"
+#include "ConvexVolume.h"
 
 #include "MechanicalActorComponent.h"
 
 #include "BubbleCageCell.h"
+#include "BubbleCageContact.h"
+#include "BubbleCageHit.h"
+#include "BubbleCageKernel.h"
 #include "BubbleSphere.h"
 #include "Located.h"
 
@@ -45,6 +51,90 @@ struct APPARATISTRUNTIME_API FCoupling
 	GENERATED_BODY()
 };
 
+/**
+ * The way the cage cells get filled with the bubbles.
+ */
+UENUM(BlueprintType, Category = "BubbleCage")
+enum class EBubbleCageUpdateMode : uint8
+{
+	/**
+	 * Add each of the subjects to its cell under the cell's lock.
+	 */
+	Locking,
+
+	/**
+	 * Count the subjects per cell, prefix-sum the counts and
+	 * scatter the subjects into a single contiguous array.
+	 * 
+	 * No locks and no per-cell allocations are involved here.
+	 * The cells can't be altered in-place though, so the decoupled
+	 * subjects stay in their former cells until the next update.
+	 */
+	CountingSort,
+
+	/**
+	 * Keep the cells between the updates, moving only
+	 * the subjects that have actually changed their cells.
+	 * 
+	 * The despawned subjects are purged from the cells
+	 * lazily along with the cells' fingerprints.
+	 * 
+	 * @note The newly spawned bubbles are expected
+	 * to have their cell index unset.
+	 */
+	Incremental
+};
+
+/**
+ * The way the bubbles leaving the cage are treated.
+ */
+UENUM(BlueprintType, Category = "BubbleCage")
+enum class EBubbleCageBoundsPolicy : uint8
+{
+	/**
+	 * Despawn the bubble.
+	 */
+	Despawn,
+
+	/**
+	 * Keep the bubble at the nearest location within the bounds.
+	 */
+	Clamp,
+
+	/**
+	 * Mirror the bubble back from the bound it has crossed.
+	 */
+	Reflect,
+
+	/**
+	 * Move the bubble to the opposite side of the cage.
+	 * 
+	 * The cage gets periodic, so the bubbles near
+	 * the opposite faces collide with each other.
+	 * 
+	 * Only the collisions are periodic. The region
+	 * queries and the casts don't wrap around, so those
+	 * crossing the bounds will not find the bubbles
+	 * on the opposite side of the cage.
+	 */
+	Wrap,
+
+	/**
+	 * Keep the bubble outside, binning it within
+	 * the nearest border cell.
+	 * 
+	 * The bubbles far away from the cage will
+	 * crowd the border cells, so this is only suitable
+	 * for the occasional short excursions. The region
+	 * queries test each of the border bubbles individually,
+	 * while the casts and the sweeps test those
+	 * without any early-outs. The casts are still clipped
+	 * to the cage, so only the overflowing bubbles
+	 * binned within the reach of a cast are hit.
+	 */
+	Overflow
+};
+
 /**
  * A simple and performant collision detection and decoupling for spheres.
  */
@@ -63,11 +153,85 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 	 */
 	float LargestRadius = 0.0f;
 
+	/**
+	 * The lowest cage-local height among
+	 * the centers of the bubbles.
+	 * 
+	 * Only gathered in the planar mode, where
+	 * the cells span all of the heights.
+	 */
+	float LowestHeight = 0.0f;
+
+	/**
+	 * The highest cage-local height among
+	 * the centers of the bubbles.
+	 * 
+	 * Only gathered in the planar mode, where
+	 * the cells span all of the heights.
+	 */
+	float HighestHeight = 0.0f;
+
+	/**
+	 * The maximum number of the cage levels.
+	 */
+	static constexpr int32 MaxLevelsCount = 8;
+
+	/**
+	 * The largest radius among the bubbles of each of the levels.
+	 * 
+	 * Negative for the empty levels.
+	 */
+	TArray<float, TInlineAllocator<MaxLevelsCount>> LevelLargestRadii;
+
+	/**
+	 * The largest distance the subjects have traveled
+	 * since they were put into their current cells.
+	 * 
+	 * The packed cells can't be altered in-place, so the
+	 * searches get widened by this value until the next update.
+	 */
+	float DisplacementSlack = 0.0f;
+
+	/**
+	 * The deepest penetration among the bubbles
+	 * detected during the latest decoupling.
+	 */
+	float MaxPenetration = 0.0f;
+
+	/**
+	 * The completion fence of the latest asynchronous evaluation.
+	 */
+	FGraphEventRef PendingEvaluation;
+
+	/**
+	 * The identifier of the thread running
+	 * the asynchronous evaluation.
+	 * 
+	 * Zero, if there is no evaluation running.
+	 */
+	std::atomic<uint32> EvaluatingThreadId{0};
+
+	/**
+	 * Are there any deferreds left to be applied
+	 * after the asynchronous evaluation?
+	 * 
+	 * Those are applied on the game thread
+	 * within WaitForEvaluation().
+	 */
+	bool bDeferredsPending = false;
+
+	/**
+	 * Was the synchronous fallback of
+	 * the asynchronous evaluation reported already?
+	 */
+	bool bSynchronousEvaluationReported = false;
+
   public:
 
 	void
 	BeginDestroy() override
 	{		
+		WaitForEvaluation();
 		Super::BeginDestroy();
 	}
 
@@ -99,6 +263,34 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Volume", Meta = (AllowPrivateAccess))
 	FIntVector Size;
 
+	/**
+	 * Lay out the cells within a single XY-plane.
+	 * 
+	 * The Z-coordinates of the bubbles are passed through,
+	 * so the bubbles are decoupled by their XY-distances only
+	 * and are never despawned due to their height. The size
+	 * of the cage along Z is forced to 1, while the decoupling
+	 * loops are specialized for the plane at compile time.
+	 * The queries still measure the full 3D distances.
+	 * The pairwise and the sharded detections are not used
+	 * within this mode.
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Volume", Meta = (AllowPrivateAccess))
+	bool bPlanar = false;
+
+	/**
+	 * The number of the cage levels.
+	 * 
+	 * The cells of each next level are twice as large
+	 * as the ones of the previous level. The bubbles are put
+	 * into the levels according to their radii, so the small
+	 * bubbles don't have to scan the vast neighbourhoods
+	 * just because of some giant ones present in the cage.
+	 * Only applicable to the packed (counting sort or sparse) cells.
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Volume", Meta = (AllowPrivateAccess, ClampMin = "1", ClampMax = "8"))
+	int32 LevelsCount = 1;
+
 	/**
 	 * The bounds of the cage in world units.
 	 * 
@@ -107,6 +299,17 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "Volume", Meta = (AllowPrivateAccess))
 	mutable FBox Bounds;
 
+	/**
+	 * The way the bubbles leaving the bounds are treated.
+	 * 
+	 * Only the overlap queries and the decoupling
+	 * are wrapped around the periodic cage, while the casts
+	 * and the nearest searches are not. The pairwise and
+	 * the sharded detections are not used when wrapping.
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Volume", Meta = (AllowPrivateAccess))
+	EBubbleCageBoundsPolicy BoundsPolicy = EBubbleCageBoundsPolicy::Despawn;
+
 	/**
 	 * The decoupling algorithm will be run in parallel through a dedicated trait.
 	 * 
@@ -115,218 +318,2076 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Performance", Meta = (AllowPrivateAccess))
 	bool bDecoupleViaTrait = false;
 
-
-	bool bInitialized = false;
-
 	/**
-	 * All of the cells of the cage.
+	 * Enumerate each of the coupled pairs only once,
+	 * correcting both of the bubbles at the same time.
+	 * 
+	 * Only the forward half of the neighbourhood is
+	 * scanned for each of the cells, while the corrections
+	 * are accumulated within the per-thread buffers.
+	 * Only applicable to the packed (counting sort or sparse) cells.
 	 */
-	TArray<FBubbleCageCell> Cells;
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Performance", Meta = (AllowPrivateAccess))
+	bool bDecouplePairwise = false;
 
 	/**
-	 * The indices of the cells that are currently occupied by the subjects.
+	 * The way the cells get filled during the update.
 	 */
-	TQueue<int32, EQueueMode::Mpsc> OccupiedCells;
-
-	struct FCouplingEntry
-	{
-		FSubjectHandle Subject;
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Performance", Meta = (AllowPrivateAccess))
+	EBubbleCageUpdateMode UpdateMode = EBubbleCageUpdateMode::Locking;
 
-		FLocated* Located = nullptr;
+	/**
+	 * Store only the occupied cells within a hash table.
+	 * 
+	 * The memory then scales with the number of bubbles
+	 * instead of the volume of the cage, so the cage may
+	 * be arbitrarily large. The sparse cells are always
+	 * filled via the counting sort, regardless of the update mode.
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Performance", Meta = (AllowPrivateAccess))
+	bool bSparseCells = false;
 
-		FBubbleSphere* BubbleSphere = nullptr;
+	/**
+	 * Lay out the dense cells in a Z-order (Morton) curve.
+	 * 
+	 * The cells are grouped into 8x8x8 bricks with
+	 * a Morton order inside each of them, so the neighboring
+	 * cells occupy the nearby memory and the subjects get
+	 * decoupled in that same spatially coherent order.
+	 * Ignored for the sparse cells. The decoupling via
+	 * the trait keeps the order of the mechanism.
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Performance", Meta = (AllowPrivateAccess))
+	bool bMortonCells = false;
 
-		FORCEINLINE
-		FCouplingEntry()
-		{}
+	/**
+	 * The number of the spatial shards to detect the collisions within.
+	 * 
+	 * The cage is split into the boxy tiles of the cells, cutting
+	 * its longest axes first, so the flat cages get tiled in 2D.
+	 * Each tile is owned by a single worker that gathers
+	 * the decouples of its own bubbles only. The border cells
+	 * of the neighbouring tiles serve as the halo, read in place
+	 * from the packed snapshot, so the shards don't synchronize
+	 * with each other until the detection is over.
+	 * 
+	 * The actual number of the shards is at most this value
+	 * and never exceeds the number of the cells, since a tile
+	 * is at least a single cell across. Only applicable
+	 * to the dense single-level packed cells
+	 * in the row-major layout. Set to 1 to disable.
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Performance", Meta = (AllowPrivateAccess, ClampMin = "1"))
+	int32 ShardsCount = 1;
 
-		FORCEINLINE
-		FCouplingEntry(FSubjectHandle InSubject, FLocated* InLocated, FBubbleSphere* InBubbleSphere)
-		  : Subject(InSubject), Located(InLocated), BubbleSphere(InBubbleSphere)
-		{}
-	};
+	/**
+	 * The number of incremental updates between
+	 * the compactions of the cells.
+	 * 
+	 * The compaction purges the despawned subjects
+	 * from the cells and rebuilds their fingerprints.
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Performance", Meta = (AllowPrivateAccess, ClampMin = "1"))
+	int32 CompactionPeriod = 60;
 
 	/**
-	 * All the subjects that are actually coupling with each other and need decoupling.
+	 * The maximum number of the decoupling passes
+	 * performed during a single evaluation.
+	 * 
+	 * The dense crowds need several relaxation passes
+	 * to actually separate, while the cage is reused
+	 * among the passes instead of being rebuilt.
 	 */
-	TQueue<FCouplingEntry, EQueueMode::Mpsc> CoupledSubjects;
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Solver", Meta = (AllowPrivateAccess, ClampMin = "1"))
+	int32 SolverIterationsCount = 1;
 
 	/**
-	 * Initialize the internal cells array.
+	 * The penetration depth considered to be acceptable.
+	 * 
+	 * The evaluation stops early as soon as the deepest
+	 * penetration among the bubbles is within this tolerance.
 	 */
-	void
-	DoInitializeCells()
-	{
-		Cells.Reset(); // Make sure there are no cells.
-		if (ensureAlwaysMsgf((int64)Size.X * (int64)Size.Y * (int64)Size.Z < (int64)TNumericLimits<int32>::Max(),
-							 TEXT("The '%s' bubble cage has too many cells in it. Please, decrease its corresponding size in cells."),
-							 *GetName()))
-		{
-			Cells.AddDefaulted(Size.X * Size.Y * Size.Z);
-		}
-	}
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Solver", Meta = (AllowPrivateAccess, ClampMin = "0"))
+	float PenetrationTolerance = 0.0f;
 
-#pragma region UActorComponent
+	/**
+	 * May any of the bubbles be backed by the actors?
+	 * 
+	 * The actor-backed bubbles may only be changed
+	 * on the game thread, while the deferreds of the
+	 * concurrent passes get applied by those passes themselves.
+	 * The asynchronous evaluation is thereby performed
+	 * synchronously, unless this is disabled.
+	 * Disable only if all of the bubbles are plain subjects.
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Performance", Meta = (AllowPrivateAccess))
+	bool bActorBubbles = true;
 
-	void
-	InitializeComponent() override;
+	/**
+	 * Produce bit-identical results regardless of
+	 * the number of threads and their scheduling.
+	 * 
+	 * The cells get their subjects sorted by their identifiers,
+	 * while each of the bubbles accumulates its own corrections
+	 * in the order of the cells. The pairwise decoupling
+	 * is not used within this mode, since its per-thread
+	 * buffers depend on the number of threads.
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Solver", Meta = (AllowPrivateAccess))
+	bool bDeterministic = false;
 
-#pragma endregion UActorComponent
+	/**
+	 * Test the whole motion of the fast bubbles
+	 * since the previous evaluation.
+	 * 
+	 * The bubbles moving farther than their radius are swept
+	 * from their previous locations to the current ones, so they
+	 * don't tunnel through the thin crowds. A bubble hitting
+	 * another one along the way is rewound to the first impact.
+	 * The cells are iterated along the motion only.
+	 * Only applicable to the per-bubble detection,
+	 * i.e. neither the pairwise nor the sharded one.
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Solver", Meta = (AllowPrivateAccess))
+	bool bSweptDecoupling = false;
 
+	/**
+	 * Keep the set of the touching bubbles
+	 * along with the began and ended contacts.
+	 * 
+	 * The contacts are gathered as a by-product
+	 * of the first decoupling pass of an evaluation.
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Contacts", Meta = (AllowPrivateAccess))
+	bool bTrackContacts = false;
 
-  public:
+	/**
+	 * The number of the consecutive evaluations a bubble
+	 * has to rest for to fall asleep.
+	 * 
+	 * The sleeping bubbles don't search for their neighbours,
+	 * so the decoupling cost follows the activity instead of
+	 * the population. A sleeping bubble is woken as soon as it
+	 * gets moved or some moving neighbour gets into contact
+	 * with it. The contacts of the sleeping bubbles are kept
+	 * as they were when they fell asleep.
+	 * Only applicable to the per-bubble detection,
+	 * i.e. neither the pairwise nor the sharded one.
+	 * Set to 0 to disable.
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Sleeping", Meta = (AllowPrivateAccess, ClampMin = "0"))
+	int32 SleepEvaluationsCount = 0;
 
-#pragma region Debugging
-	/// @name Debugging
-	/// @{
+	/**
+	 * The largest distance a bubble may drift
+	 * from its rest location while still resting.
+	 */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Sleeping", Meta = (AllowPrivateAccess, ClampMin = "0"))
+	float SleepTolerance = 0.1f;
 
-#if WITH_EDITORONLY_DATA
+	bool bInitialized = false;
 
 	/**
-	 * Should individual cage cells be drawn in the debugging mode.
+	 * Were the cells filled at least once, so
+	 * they can be updated incrementally
+	 * or traversed in their order.
 	 */
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Debugging")
-	bool bDebugDrawCageCells = false;
+	bool bCellsFilled = false;
 
-#endif // WITH_EDITORONLY_DATA
+	/**
+	 * The number of incremental updates since the latest compaction.
+	 */
+	int32 UpdatesSinceCompaction = 0;
 
-	/// @}
-#pragma endregion Debugging
+	/**
+	 * All of the cells of the cage.
+	 * 
+	 * Only used in the locking update mode.
+	 */
+	TArray<FBubbleCageCell> Cells;
 
 	/**
-	 * Initialize the defaults for the bubble cage component.
+	 * The indices of the first cells of the levels.
+	 * 
+	 * Contains an additional trailing element with
+	 * the total number of the cells.
+	 * Not used in the sparse cells mode.
 	 */
-	UBubbleCageComponent();
+	TArray<int32, TInlineAllocator<MaxLevelsCount + 1>> LevelBases;
 
 	/**
-	 * Get the size of a single cell in global units.
+	 * The ranges of the cells within the packed subjects.
+	 * 
+	 * The subjects of the i-th cell are stored within
+	 * the [CellOffsets[i], CellOffsets[i + 1]) range.
+	 * Only used in the counting sort update mode.
 	 */
-	const auto
-	GetCellSize() const
-	{
-		return CellSize;
-	}
+	TArray<int32> CellOffsets;
 
 	/**
-	 * Get the size of the cage in cells among each axis.
+	 * The histogram of the subjects among the cells.
+	 * 
+	 * Gets zeroed right after the prefix sum.
+	 * Only used in the counting sort update mode.
 	 */
-	const FIntVector&
-	GetSize() const
-	{
-		return Size;
-	}
+	TArray<int32> CellCounts;
 
 	/**
-	 * Get the global bounds of the cage in world units.
+	 * The accumulated fingerprints of the packed cells.
+	 * 
+	 * The fingerprints of the empty cells are not maintained.
+	 * Only used in the counting sort update mode.
 	 */
-	const FBox&
-	GetBounds() const
-	{
-		if (bInitialized)
-		{
-			return Bounds;
-		}
-		const auto Extents = CellSize * FVector(Size) * 0.5f;
-		const auto Actor = GetOwner();
-		const auto Location = (Actor != nullptr) ? Actor->GetActorLocation() : FVector::ZeroVector;
-		Bounds.Min = Location - Extents;
-		Bounds.Max = Location + Extents;
-		return Bounds;
-	}
+	TArray<FFingerprint> CellFingerprints;
 
 	/**
-	 * Convert a global 3D location to a position within the cage.
+	 * The accumulated collision layers of the packed cells.
 	 * 
-	 * No bounding checks are performed.
+	 * The layers of the empty cells are not maintained.
+	 * Only used in the counting sort update mode.
 	 */
-	FORCEINLINE FIntVector
-	WorldToCage(FVector Point) const
-	{
-		Point -= Bounds.Min;
-		Point *= InvCellSizeCache;
-		return FIntVector(FMath::FloorToInt(Point.X),
-						  FMath::FloorToInt(Point.Y),
-						  FMath::FloorToInt(Point.Z));
-	}
+	TArray<uint32> CellLayers;
 
 	/**
-	 * Convert a global 3D location to a position within the bounds.
+	 * All of the subjects within the cage ordered by their cells.
 	 * 
-	 * No bounding checks are performed.
+	 * Only used in the counting sort update mode.
 	 */
-	FORCEINLINE FVector
-	WorldToBounded(const FVector& Point) const
-	{
-		return Point - Bounds.Min;
-	}
+	TArray<FSubjectHandle> PackedSubjects;
 
 	/**
-	 * Convert a cage-local 3D location to a position within the cage.
+	 * The cage-local X-coordinates of the packed subjects.
 	 * 
-	 * No bounding checks are performed.
+	 * Together with the other packed arrays these form a
+	 * structure-of-arrays snapshot of the occupants,
+	 * stored in the very same order as the packed subjects.
+	 * Only used in the counting sort update mode.
 	 */
-	FORCEINLINE FIntVector
-	BoundedToCage(FVector Point) const
-	{
-		Point *= InvCellSizeCache;
-		return FIntVector(FMath::FloorToInt(Point.X),
-						  FMath::FloorToInt(Point.Y),
-						  FMath::FloorToInt(Point.Z));
-	}
+	TArray<float> PackedLocationsX;
 
-	/* Get the index of the cage cell. */
-	FORCEINLINE int32
-	GetIndexAt(int32 X, int32 Y, int32 Z) const
-	{
-		X = FMath::Clamp(X, 0, Size.X - 1);
-		Y = FMath::Clamp(Y, 0, Size.Y - 1);
-		Z = FMath::Clamp(Z, 0, Size.Z - 1);
-		return X + Size.X * (Y + Size.Y * Z);
-	}
+	/**
+	 * The cage-local Y-coordinates of the packed subjects.
+	 */
+	TArray<float> PackedLocationsY;
 
 	/**
-	 * Get overlapping spheres for the specified location.
+	 * The cage-local Z-coordinates of the packed subjects.
 	 */
-	int32
-	GetOverlapping(const FVector&          Location,
-				   TArray<FSubjectHandle>& OutOverlappers) const
+	TArray<float> PackedLocationsZ;
+
+	/**
+	 * The bubble radii of the packed subjects.
+	 */
+	TArray<float> PackedRadii;
+
+	/**
+	 * The decoupling strengths of the packed subjects.
+	 */
+	TArray<float> PackedDecoupleProportions;
+
+	/**
+	 * The collision layers of the packed subjects.
+	 */
+	TArray<uint32> PackedLayers;
+
+	/**
+	 * The collision masks of the packed subjects.
+	 */
+	TArray<uint32> PackedMasks;
+
+	/**
+	 * The per-thread decoupling accumulators of the pairwise decoupling.
+	 * 
+	 * Indexed by the packed subject indices with the XYZ
+	 * being the accumulated decouple and W being the number
+	 * of decouples. The first buffer gets the reduced result.
+	 */
+	TArray<TArray<FVector4f>> PairwiseDecouples;
+
+	/**
+	 * The open-addressing hash table of the sparse cells.
+	 * 
+	 * Each slot contains the packed cage position of the cell
+	 * or the #EmptySparseKey. The slot index is used as the index
+	 * of the cell within the rest of the packed arrays.
+	 * Only used in the sparse cells mode.
+	 */
+	TArray<uint64> SparseKeys;
+
+	/**
+	 * The key of an unoccupied sparse cell slot.
+	 */
+	static constexpr uint64 EmptySparseKey = ~(uint64)0;
+
+	/**
+	 * The number of the occupied sparse cell slots.
+	 * 
+	 * The hash table is grown as soon as it gets half-full,
+	 * so the linear probing stays short.
+	 */
+	std::atomic<int32> SparseCellsNum{0};
+
+	/**
+	 * The number of bits per a single axis within a sparse key.
+	 * 
+	 * The level of the cell is stored right after the axes.
+	 */
+	static constexpr int32 SparseKeyAxisBits = 20;
+
+	/**
+	 * The minimal number of slots in the sparse hash table.
+	 */
+	static constexpr int32 MinSparseCellsNum = 1024;
+
+	/**
+	 * The indices of the cells that are currently occupied by the subjects.
+	 */
+	TQueue<int32, EQueueMode::Mpsc> OccupiedCells;
+
+	/**
+	 * The number of the subjects within the unpacked cells.
+	 * 
+	 * Includes the despawned subjects
+	 * that are not compacted yet.
+	 */
+	std::atomic<int32> CellOccupantsNum{0};
+
+	/**
+	 * The occupied unpacked cells in the order of
+	 * the Morton layout to detect the collisions within.
+	 */
+	TArray<int32> MortonCells;
+
+	struct FCouplingEntry
 	{
-		OutOverlappers.Reset();
-		const auto Range = FVector(LargestRadius);
-		const auto CagePosMin = WorldToCage(Location - Range);
-		const auto CagePosMax = WorldToCage(Location + Range);
-		for (auto i = CagePosMin.X; i <= CagePosMax.X; ++i)
+		FSubjectHandle Subject;
+
+		FLocated* Located = nullptr;
+
+		FBubbleSphere* BubbleSphere = nullptr;
+
+		FORCEINLINE
+		FCouplingEntry()
+		{}
+
+		FORCEINLINE
+		FCouplingEntry(FSubjectHandle InSubject, FLocated* InLocated, FBubbleSphere* InBubbleSphere)
+		  : Subject(InSubject), Located(InLocated), BubbleSphere(InBubbleSphere)
+		{}
+	};
+
+	/**
+	 * All the subjects that are actually coupling with each other and need decoupling.
+	 */
+	TQueue<FCouplingEntry, EQueueMode::Mpsc> CoupledSubjects;
+
+	/**
+	 * The sleeping subjects got into contact
+	 * with some moving ones and have to be woken.
+	 */
+	TQueue<FSubjectHandle, EQueueMode::Mpsc> WokenSubjects;
+
+	/**
+	 * The coupled subjects drained from the queue
+	 * to be decoupled concurrently.
+	 */
+	TArray<FCouplingEntry> CouplingEntries;
+
+	/**
+	 * The minimum number of the contacts to reserve
+	 * for a single detection pass.
+	 */
+	static constexpr int32 MinContactsNum = 1024;
+
+	/**
+	 * Is the next decoupling the first pass of an evaluation.
+	 * 
+	 * Only the first pass of the solver gathers the contacts
+	 * and tracks the resting bubbles.
+	 */
+	bool bFirstPass = true;
+
+	/**
+	 * The contacts being gathered during the current detection.
+	 * 
+	 * Reserved ahead judging by the previous number of contacts,
+	 * while being filled via #ContactsCursor concurrently.
+	 */
+	TArray<FBubbleCageContact> GatheredContacts;
+
+	/**
+	 * The next free place within the gathered contacts.
+	 */
+	std::atomic<int32> ContactsCursor{0};
+
+	/**
+	 * The contacts not fitting into the reserved ones.
+	 */
+	TArray<FBubbleCageContact> OverflowContacts;
+
+	/**
+	 * The lock for the overflown contacts.
+	 */
+	FCriticalSection OverflowContactsLock;
+
+	/**
+	 * All of the current contacts sorted by their keys.
+	 */
+	TArray<FBubbleCageContact> Contacts;
+
+	/**
+	 * The contacts that have begun during the latest detection.
+	 */
+	TArray<FBubbleCageContact> BeganContacts;
+
+	/**
+	 * The contacts that were present during the previous detection
+	 * and are still present.
+	 */
+	TArray<FBubbleCageContact> PersistingContacts;
+
+	/**
+	 * The contacts that have ended during the latest detection.
+	 */
+	TArray<FBubbleCageContact> EndedContacts;
+
+	/**
+	 * Get overlapping spheres for a batch of locations,
+	 * optionally filtering them.
+	 */
+	template < bool bFiltered >
+	int32
+	DoGetOverlappingBatch(TArrayView<const FVector> Locations,
+						  TArrayView<const float>   Radii,
+						  const FFilter&            Filter,
+						  TArray<FSubjectHandle>&   OutOverlappers,
+						  TArray<int32>&            OutOffsets) const;
+
+	/**
+	 * Initialize the internal cells array.
+	 */
+	void
+	DoInitializeCells()
+	{
+		// Make sure there are no cells.
+		Cells.Reset();
+		CellOccupantsNum.store(0, std::memory_order_relaxed);
+		CellOffsets.Reset();
+		CellCounts.Reset();
+		CellFingerprints.Reset();
+		CellLayers.Reset();
+		PackedSubjects.Reset();
+		PackedLocationsX.Reset();
+		PackedLocationsY.Reset();
+		PackedLocationsZ.Reset();
+		PackedRadii.Reset();
+		PackedDecoupleProportions.Reset();
+		PackedLayers.Reset();
+		PackedMasks.Reset();
+		SparseKeys.Reset();
+		LevelBases.Reset();
+		LevelLargestRadii.Init(-1.0f, GetLevelsNum());
+		if (bSparseCells)
+		{
+			if (ensureAlwaysMsgf(FMath::Max3(Size.X, Size.Y, Size.Z) < (1 << SparseKeyAxisBits),
+								 TEXT("The '%s' bubble cage is too large even for the sparse cells. Please, decrease its corresponding size in cells."),
+								 *GetName()))
+			{
+				ResetSparseCells(MinSparseCellsNum);
+			}
+			return;
+		}
+		int64 TotalCellsNum = 0;
+		for (int32 Level = 0; Level < GetLevelsNum(); ++Level)
+		{
+			const auto LevelSize = GetLevelSize(Level);
+			TotalCellsNum += GetLayoutVolume(LevelSize);
+		}
+		if (ensureAlwaysMsgf(TotalCellsNum < (int64)TNumericLimits<int32>::Max(),
+							 TEXT("The '%s' bubble cage has too many cells in it. Please, decrease its corresponding size in cells."),
+							 *GetName()))
+		{
+			const auto CellsNum = (int32)TotalCellsNum;
+			LevelBases.Add(0);
+			for (int32 Level = 0; Level < GetLevelsNum(); ++Level)
+			{
+				const auto LevelSize = GetLevelSize(Level);
+				LevelBases.Add(LevelBases.Last() + (int32)GetLayoutVolume(LevelSize));
+			}
+			if (UpdateMode == EBubbleCageUpdateMode::CountingSort)
+			{
+				CellOffsets.SetNumZeroed(CellsNum + 1);
+				CellCounts.SetNumZeroed(CellsNum);
+				CellFingerprints.AddDefaulted(CellsNum);
+				CellLayers.SetNumZeroed(CellsNum);
+			}
+			else
+			{
+				Cells.AddDefaulted(CellsNum);
+			}
+		}
+	}
+
+	/**
+	 * Atomically raise the value up to the specified one.
+	 */
+	static FORCEINLINE void
+	AtomicMax(std::atomic<float>& Value, const float Candidate)
+	{
+		auto Current = Value.load(std::memory_order_relaxed);
+		while ((Current < Candidate) &&
+			   !Value.compare_exchange_weak(Current, Candidate, std::memory_order_relaxed));
+	}
+
+	/**
+	 * Atomically lower the value down to the specified one.
+	 */
+	static FORCEINLINE void
+	AtomicMin(std::atomic<float>& Value, const float Candidate)
+	{
+		auto Current = Value.load(std::memory_order_relaxed);
+		while ((Current > Candidate) &&
+			   !Value.compare_exchange_weak(Current, Candidate, std::memory_order_relaxed));
+	}
+
+	/**
+	 * Gather the height of a bubble in the planar mode.
+	 */
+	FORCEINLINE void
+	GatherHeight(std::atomic<float>& Lowest,
+				 std::atomic<float>& Highest,
+				 const FVector&      Location) const
+	{
+		if (!bPlanar) return;
+		const auto Height = (float)(Location.Z - Bounds.Min.Z);
+		AtomicMin(Lowest, Height);
+		AtomicMax(Highest, Height);
+	}
+
+	/**
+	 * Check if the cage is filled via the counting sort.
+	 */
+	FORCEINLINE bool
+	IsPacked() const
+	{
+		return bSparseCells || (UpdateMode == EBubbleCageUpdateMode::CountingSort);
+	}
+
+	/**
+	 * Get the number of the levels actually used.
+	 */
+	FORCEINLINE int32
+	GetLevelsNum() const
+	{
+		return IsPacked() ? FMath::Clamp(LevelsCount, 1, MaxLevelsCount) : 1;
+	}
+
+	/**
+	 * Get the size of a level in its cells among each axis.
+	 */
+	FORCEINLINE FIntVector
+	GetLevelSize(const int32 Level) const
+	{
+		const auto Rounding = (1 << Level) - 1;
+		return FIntVector((Size.X + Rounding) >> Level,
+						  (Size.Y + Rounding) >> Level,
+						  (Size.Z + Rounding) >> Level);
+	}
+
+	/**
+	 * Get the level a bubble of a certain radius belongs to.
+	 * 
+	 * This is the finest level which cells are
+	 * at least as large as the bubble's diameter.
+	 */
+	FORCEINLINE int32
+	GetLevelOf(const float Radius) const
+	{
+		const auto Span = FMath::Min(2 * Radius * InvCellSizeCache, (float)(1 << MaxLevelsCount));
+		if (Span <= 1.0f)
+		{
+			return 0;
+		}
+		return FMath::Min((int32)FMath::CeilLogTwo((uint32)FMath::CeilToInt(Span)), GetLevelsNum() - 1);
+	}
+
+	/**
+	 * Make a sparse hash key out of a position within a level.
+	 */
+	static FORCEINLINE uint64
+	MakeSparseKey(const FIntVector& CellPoint, const int32 Level = 0)
+	{
+		return  (uint64)CellPoint.X |
+			   ((uint64)CellPoint.Y << SparseKeyAxisBits) |
+			   ((uint64)CellPoint.Z << (2 * SparseKeyAxisBits)) |
+			   ((uint64)Level << (3 * SparseKeyAxisBits));
+	}
+
+	/**
+	 * Get the initial slot of a sparse key.
+	 */
+	FORCEINLINE uint32
+	GetSparseSlot(const uint64 Key) const
+	{
+		// Fibonacci hashing:
+		return (uint32)((Key * 0x9E3779B97F4A7C15ull) >> 32) & (uint32)(SparseKeys.Num() - 1);
+	}
+
+	/**
+	 * Find the slot of a sparse cell, occupying a new one if needed.
+	 * 
+	 * This method is thread-safe.
+	 * 
+	 * @return The index of the slot or @c INDEX_NONE,
+	 * if the hash table has got more than half-full
+	 * and has to be grown.
+	 */
+	FORCEINLINE int32
+	FindOrAddSparseCell(const uint64 Key)
+	{
+		const auto Mask = (uint32)(SparseKeys.Num() - 1);
+		auto Slot = GetSparseSlot(Key);
+		for (uint32 Probe = 0; Probe <= Mask; ++Probe)
 		{
-			for (auto j = CagePosMin.Y; j <= CagePosMax.Y; ++j)
+			const auto SlotKey = (volatile int64*)&SparseKeys[Slot];
+			auto Existing = (uint64)FPlatformAtomics::AtomicRead(SlotKey);
+			if (Existing == EmptySparseKey)
 			{
-				for (auto k = CagePosMin.Z; k <= CagePosMax.Z; ++k)
+				Existing = (uint64)FPlatformAtomics::InterlockedCompareExchange(SlotKey, (int64)Key, (int64)EmptySparseKey);
+				if (Existing == EmptySparseKey)
 				{
-					const auto NeighbourCellPos = FIntVector(i, j, k);
-					if (LIKELY(IsInside(NeighbourCellPos)))
+					const auto CellsNum = SparseCellsNum.fetch_add(1, std::memory_order_relaxed) + 1;
+					if (UNLIKELY(CellsNum > SparseKeys.Num() / 2))
 					{
-						const auto& NeighbourCell = At(NeighbourCellPos);
-						for (int32 t = 0; t < NeighbourCell.Subjects.Num(); ++t)
-						{
-							const auto OtherBubble = NeighbourCell.Subjects[t];
-							if (LIKELY(OtherBubble))
-							{
-								const auto OtherBubbleSphere =
-									OtherBubble.GetTrait<FBubbleSphere>();
-								const auto OtherLocation =
-									OtherBubble.GetTrait<FLocated>().GetLocation();
-								const auto Delta = Location - OtherLocation;
-								const float DistanceSqr = Delta.SizeSquared();
-								if (FMath::Square(OtherBubbleSphere.Radius) > DistanceSqr)
-								{
-									OutOverlappers.Add(OtherBubble);
-								}
-							}
-						}
+						return INDEX_NONE;
 					}
+					return (int32)Slot;
 				}
 			}
+			if (Existing == Key)
+			{
+				return (int32)Slot;
+			}
+			Slot = (Slot + 1) & Mask;
 		}
-		return OutOverlappers.Num();
+		return INDEX_NONE;
+	}
+
+	/**
+	 * Find the slot of an occupied sparse cell.
+	 * 
+	 * @return The index of the slot or @c INDEX_NONE,
+	 * if the cell is not occupied.
+	 */
+	FORCEINLINE int32
+	FindSparseCell(const uint64 Key) const
+	{
+		const auto Mask = (uint32)(SparseKeys.Num() - 1);
+		auto Slot = GetSparseSlot(Key);
+		for (uint32 Probe = 0; Probe <= Mask; ++Probe)
+		{
+			const auto Existing = SparseKeys[Slot];
+			if (Existing == Key)
+			{
+				return (int32)Slot;
+			}
+			if (Existing == EmptySparseKey)
+			{
+				break;
+			}
+			Slot = (Slot + 1) & Mask;
+		}
+		return INDEX_NONE;
+	}
+
+	/**
+	 * Clear the sparse cells, resizing the hash table if needed.
+	 */
+	void
+	ResetSparseCells(const int32 SlotsNum);
+
+	/**
+	 * Get the accumulated fingerprint of a cell
+	 * regardless of the update mode.
+	 */
+	FORCEINLINE const FFingerprint&
+	GetCellFingerprint(const int32 CellIndex) const
+	{
+		return IsPacked() ? CellFingerprints[CellIndex] : Cells[CellIndex].Fingerprint;
+	}
+
+	/**
+	 * Get the accumulated collision layers of a cell
+	 * regardless of the update mode.
+	 */
+	FORCEINLINE uint32
+	GetCellLayers(const int32 CellIndex) const
+	{
+		return IsPacked() ? CellLayers[CellIndex] : (uint32)Cells[CellIndex].Layers;
+	}
+
+	/**
+	 * All of the collision layers.
+	 * 
+	 * The layers are not tested at all with this mask,
+	 * so the bubbles without any layers are matched as well.
+	 */
+	static constexpr uint32 AllLayers = ~0u;
+
+	/**
+	 * A snapshot of a cage occupant used during the narrow phase.
+	 */
+	struct FOccupant
+	{
+		/**
+		 * The subject of the occupant.
+		 * 
+		 * The packed subjects may already be despawned,
+		 * so this has to be checked before the actual use.
+		 */
+		FSubjectHandle Subject;
+
+		/// The cage-local location of the occupant.
+		FVector3f Location;
+
+		/// The radius of the occupant's bubble.
+		float Radius = 0;
+
+		/// The decoupling strength of the occupant's bubble.
+		float DecoupleProportion = 0;
+
+		/// The collision layers of the occupant's bubble.
+		uint32 Layers = 0;
+
+		/// The collision mask of the occupant's bubble.
+		uint32 Mask = 0;
+	};
+
+	/**
+	 * Get the snapshot of a packed occupant.
+	 */
+	FORCEINLINE void
+	GetPackedOccupant(const int32 PackedIndex, FOccupant& OutOccupant) const
+	{
+		OutOccupant.Subject = PackedSubjects.GetData()[PackedIndex];
+		OutOccupant.Location = FVector3f(PackedLocationsX.GetData()[PackedIndex],
+										 PackedLocationsY.GetData()[PackedIndex],
+										 PackedLocationsZ.GetData()[PackedIndex]);
+		OutOccupant.Radius = PackedRadii.GetData()[PackedIndex];
+		OutOccupant.DecoupleProportion = PackedDecoupleProportions.GetData()[PackedIndex];
+		OutOccupant.Layers = PackedLayers.GetData()[PackedIndex];
+		OutOccupant.Mask = PackedMasks.GetData()[PackedIndex];
+	}
+
+	/**
+	 * Check if a cell may contain the bubbles
+	 * matching the filter and the collision layers.
+	 */
+	template < bool bFiltered >
+	FORCEINLINE bool
+	MatchesCell(const int32    CellIndex,
+				const FFilter* Filter,
+				const uint32   LayerMask) const
+	{
+		if ((LayerMask != AllLayers) && !(GetCellLayers(CellIndex) & LayerMask)) return false;
+		if (bFiltered) // Compile-time branch.
+		{
+			// Negative filtering can't be performed here,
+			// since the cell's fingerprint includes a sum of internals.
+			return GetCellFingerprint(CellIndex).Matches(Filter->GetFingerprint());
+		}
+		return true;
+	}
+
+	/**
+	 * Check if an occupant matches
+	 * the filter and the collision layers.
+	 */
+	template < bool bFiltered >
+	FORCEINLINE bool
+	MatchesOccupant(const FOccupant& Occupant,
+					const FFilter*   Filter,
+					const uint32     LayerMask) const
+	{
+		if ((LayerMask != AllLayers) && !(Occupant.Layers & LayerMask)) return false;
+		return bFiltered ? Occupant.Subject.Matches(*Filter) : (bool)Occupant.Subject;
+	}
+
+	/**
+	 * Iterate the occupants of a cell regardless of the update mode.
+	 * 
+	 * The packed cells are iterated through their structure-of-arrays
+	 * snapshot without touching the subjects' traits, while the unpacked
+	 * ones use the cage-local snapshots of their spheres.
+	 * 
+	 * @return Was the iterating completed without an early-out.
+	 */
+	template < typename FunctorT >
+	FORCEINLINE bool
+	ForEachOccupantIn(const int32 CellIndex, FunctorT&& Functor) const
+	{
+		FOccupant Occupant;
+		if (IsPacked())
+		{
+			const auto End = CellOffsets[CellIndex + 1];
+			for (int32 t = CellOffsets[CellIndex]; t < End; ++t)
+			{
+				GetPackedOccupant(t, Occupant);
+				if (!FBubbleCageKernel::Visit(Functor, (const FOccupant&)Occupant))
+				{
+					return false;
+				}
+			}
+		}
+		else
+		{
+			const auto& Cell = Cells[CellIndex];
+			for (int32 t = 0; t < Cell.Subjects.Num(); ++t)
+			{
+				if (UNLIKELY(!Cell.Subjects[t])) continue;
+				const auto& CellOccupant = Cell.Occupants[t];
+				Occupant.Subject = Cell.Subjects[t];
+				Occupant.Location = CellOccupant.Location;
+				Occupant.Radius = CellOccupant.Radius;
+				Occupant.DecoupleProportion = CellOccupant.DecoupleProportion;
+				Occupant.Layers = CellOccupant.Layers;
+				Occupant.Mask = CellOccupant.Mask;
+				if (!FBubbleCageKernel::Visit(Functor, (const FOccupant&)Occupant))
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Get the number of the subjects within all of the cells.
+	 * 
+	 * The unpacked cells may also count
+	 * the despawned subjects.
+	 */
+	FORCEINLINE int32
+	GetOccupantsNum() const
+	{
+		return IsPacked() ? PackedSubjects.Num() : CellOccupantsNum.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Get the number of the subjects within a cell.
+	 */
+	FORCEINLINE int32
+	GetCellOccupantsNum(const int32 CellIndex) const
+	{
+		return IsPacked() ? CellOffsets[CellIndex + 1] - CellOffsets[CellIndex] : Cells[CellIndex].Subjects.Num();
+	}
+
+	/**
+	 * Iterate the occupants of a cell overlapping a sphere.
+	 * 
+	 * The packed cells are tested via the vectorized kernel.
+	 * 
+	 * @tparam bFlat Should the Z-coordinates be ignored.
+	 * @param CellIndex The index of the cell to iterate.
+	 * @param LocalLocation The cage-local center of the sphere.
+	 * @param Radius The radius of the sphere.
+	 * @param Functor The functor to call for each of the overlapping occupants.
+	 * May return @c false to stop the iterating.
+	 * @return Was the iterating completed without an early-out.
+	 */
+	template < bool bFlat = false, typename FunctorT >
+	FORCEINLINE bool
+	ForEachOverlappingIn(const int32      CellIndex,
+						 const FVector3f& LocalLocation,
+						 const float      Radius,
+						 FunctorT&&       Functor) const
+	{
+		if (IsPacked())
+		{
+			FOccupant Occupant;
+			return FBubbleCageKernel::ForEachOverlapping<bFlat>(
+				LocalLocation, Radius,
+				PackedLocationsX.GetData(), PackedLocationsY.GetData(), PackedLocationsZ.GetData(),
+				PackedRadii.GetData(),
+				CellOffsets[CellIndex], CellOffsets[CellIndex + 1],
+			[&](const int32 PackedIndex)
+			{
+				GetPackedOccupant(PackedIndex, Occupant);
+				return FBubbleCageKernel::Visit(Functor, (const FOccupant&)Occupant);
+			});
+		}
+		return ForEachOccupantIn(CellIndex,
+		[&](const FOccupant& Occupant)
+		{
+			auto Delta = LocalLocation - Occupant.Location;
+			if (bFlat) // Compile-time branch.
+			{
+				Delta.Z = 0;
+			}
+			if (FMath::Square(Radius + Occupant.Radius) > Delta.SizeSquared())
+			{
+				return FBubbleCageKernel::Visit(Functor, Occupant);
+			}
+			return true;
+		});
+	}
+
+	/**
+	 * Iterate the cells of a level within a cube.
+	 * 
+	 * Only the existing cells are iterated.
+	 * 
+	 * @tparam bFlat Should the cells be iterated within
+	 * the XY-plane only, regardless of the height.
+	 * @param Level The level to iterate.
+	 * @param LocalLocation The cage-local center of the cube.
+	 * @param Range The half-extent of the cube.
+	 * @param Functor The functor to call with the index of each of the cells.
+	 * May return @c false to stop the iterating.
+	 * @return Was the iterating completed without an early-out.
+	 */
+	template < bool bFlat = false, typename FunctorT >
+	FORCEINLINE bool
+	ForEachCellWithin(const int32    Level,
+					  const FVector& LocalLocation,
+					  const float    Range,
+					  FunctorT&&     Functor) const
+	{
+		const auto LevelSize = GetLevelSize(Level);
+		const auto Center = GetSearchCenter(LocalLocation);
+		const auto CagePosMin = BoundedToCage(Center - FVector(Range));
+		const auto CagePosMax = BoundedToCage(Center + FVector(Range));
+		const auto MinX = FMath::Max(CagePosMin.X >> Level, 0);
+		const auto MinY = FMath::Max(CagePosMin.Y >> Level, 0);
+		const auto MaxX = FMath::Min(CagePosMax.X >> Level, LevelSize.X - 1);
+		const auto MaxY = FMath::Min(CagePosMax.Y >> Level, LevelSize.Y - 1);
+		if (bFlat) // Compile-time branch.
+		{
+			for (auto i = MinX; i <= MaxX; ++i)
+			{
+				for (auto j = MinY; j <= MaxY; ++j)
+				{
+					const auto CellIndex = FindCellIndex(FIntVector(i, j, 0), Level);
+					if ((CellIndex != INDEX_NONE) && !FBubbleCageKernel::Visit(Functor, CellIndex))
+					{
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+		const auto MinZ = FMath::Max(CagePosMin.Z >> Level, 0);
+		const auto MaxZ = FMath::Min(CagePosMax.Z >> Level, LevelSize.Z - 1);
+		for (auto i = MinX; i <= MaxX; ++i)
+		{
+			for (auto j = MinY; j <= MaxY; ++j)
+			{
+				for (auto k = MinZ; k <= MaxZ; ++k)
+				{
+					const auto CellIndex = FindCellIndex(FIntVector(i, j, k), Level);
+					if ((CellIndex != INDEX_NONE) && !FBubbleCageKernel::Visit(Functor, CellIndex))
+					{
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Iterate the cells that may contain the bubbles
+	 * overlapping a sphere.
+	 * 
+	 * Each of the levels is scanned with its own reach,
+	 * so the giant bubbles don't widen the searches among
+	 * the smaller ones.
+	 * 
+	 * @tparam bFlat Is the cage planar.
+	 * @param Location The global center of the sphere.
+	 * @param Radius The radius of the sphere.
+	 * @param Functor The functor to call with the index of each of the cells.
+	 * May return @c false to stop the iterating.
+	 * @return Was the iterating completed without an early-out.
+	 */
+	template < bool bFlat, typename FunctorT >
+	FORCEINLINE bool
+	DoForEachCellNear(const FVector& Location,
+					  const float    Radius,
+					  FunctorT&&     Functor) const
+	{
+		const auto LocalLocation = WorldToBounded(Location);
+		for (int32 Level = 0; Level < LevelLargestRadii.Num(); ++Level)
+		{
+			const auto LevelLargestRadius = LevelLargestRadii[Level];
+			if (LevelLargestRadius < 0) continue; // The level is empty.
+			if (!ForEachCellWithin<bFlat>(Level, LocalLocation, Radius + LevelLargestRadius + DisplacementSlack, Functor))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Iterate the cells that may contain the bubbles
+	 * overlapping a sphere.
+	 * 
+	 * @param Location The global center of the sphere.
+	 * @param Radius The radius of the sphere.
+	 * @param Functor The functor to call with the index of each of the cells.
+	 * May return @c false to stop the iterating.
+	 * @return Was the iterating completed without an early-out.
+	 */
+	template < typename FunctorT >
+	FORCEINLINE bool
+	ForEachCellNear(const FVector& Location,
+					const float    Radius,
+					FunctorT&&     Functor) const
+	{
+		if (bPlanar)
+		{
+			return DoForEachCellNear<true>(Location, Radius, Forward<FunctorT>(Functor));
+		}
+		return DoForEachCellNear<false>(Location, Radius, Forward<FunctorT>(Functor));
+	}
+
+	/**
+	 * Iterate the cells of a level along a cast via the 3D DDA.
+	 * 
+	 * Each of the visited cells is inflated to a cube of cells
+	 * covering the range of the cast, while only the leading face
+	 * of the cube is iterated on each of the steps, so each cell
+	 * gets iterated only once. The cells are iterated in the order
+	 * of the cast, so no bubble within a cell first iterated at
+	 * a certain distance can be hit closer than that distance.
+	 * The overflowing bubbles may be anywhere outside
+	 * of their border cells, so those cells are reported
+	 * at the zero distance under the overflowing policy.
+	 * 
+	 * @param Level The level to iterate.
+	 * @param LocalStart The cage-local start of the cast.
+	 * @param Direction The normalized direction of the cast.
+	 * @param Length The length of the cast.
+	 * @param Range The distance to the cast the bubbles' centers
+	 * have to be within.
+	 * @param Functor The functor to call with the index of each of
+	 * the cells and the distance along the cast it got reached at.
+	 * May return @c false to stop the iterating.
+	 * @return Was the iterating completed without an early-out.
+	 */
+	template < typename FunctorT >
+	bool
+	ForEachCellAlong(const int32      Level,
+					 const FVector3f& LocalStart,
+					 const FVector3f& Direction,
+					 const float      Length,
+					 const float      Range,
+					 FunctorT&&       Functor) const
+	{
+		const auto LevelCellSize = CellSize * (1 << Level);
+		const auto InvLevelCellSize = 1 / LevelCellSize;
+		const auto LevelSize = GetLevelSize(Level);
+		const auto Reach = FMath::CeilToInt(Range * InvLevelCellSize);
+
+		// Clip the cast to the level inflated by the reach...
+		const auto Margin = Reach * LevelCellSize;
+		auto DistanceMin = 0.0f;
+		auto DistanceMax = Length;
+		// The planar cells span all the heights...
+		const auto AxesNum = bPlanar ? 2 : 3;
+		for (int32 Axis = 0; Axis < AxesNum; ++Axis)
+		{
+			const auto Low = -Margin;
+			const auto High = LevelSize[Axis] * LevelCellSize + Margin;
+			if (FMath::Abs(Direction[Axis]) <= SMALL_NUMBER)
+			{
+				if ((LocalStart[Axis] < Low) || (LocalStart[Axis] > High)) return true;
+				continue;
+			}
+			auto DistanceLow = (Low - LocalStart[Axis]) / Direction[Axis];
+			auto DistanceHigh = (High - LocalStart[Axis]) / Direction[Axis];
+			if (DistanceLow > DistanceHigh)
+			{
+				Swap(DistanceLow, DistanceHigh);
+			}
+			DistanceMin = FMath::Max(DistanceMin, DistanceLow);
+			DistanceMax = FMath::Min(DistanceMax, DistanceHigh);
+		}
+		if (DistanceMin > DistanceMax) return true;
+
+		const auto Entry = LocalStart + Direction * DistanceMin;
+		FIntVector Cell(FMath::FloorToInt(Entry.X * InvLevelCellSize),
+						FMath::FloorToInt(Entry.Y * InvLevelCellSize),
+						bPlanar ? 0 : FMath::FloorToInt(Entry.Z * InvLevelCellSize));
+		FIntVector Step;
+		FVector3f DistanceNext;
+		FVector3f DistanceDelta;
+		for (int32 Axis = 0; Axis < 3; ++Axis)
+		{
+			if ((Axis >= AxesNum) || (FMath::Abs(Direction[Axis]) <= SMALL_NUMBER))
+			{
+				Step[Axis] = 0;
+				DistanceNext[Axis] = TNumericLimits<float>::Max();
+				DistanceDelta[Axis] = TNumericLimits<float>::Max();
+				continue;
+			}
+			Step[Axis] = (Direction[Axis] > 0) ? 1 : -1;
+			const auto Boundary = (Cell[Axis] + ((Step[Axis] > 0) ? 1 : 0)) * LevelCellSize;
+			DistanceNext[Axis] = DistanceMin + (Boundary - Entry[Axis]) / Direction[Axis];
+			DistanceDelta[Axis] = LevelCellSize / FMath::Abs(Direction[Axis]);
+		}
+
+		const auto bOverflow = (BoundsPolicy == EBubbleCageBoundsPolicy::Overflow);
+		const auto VisitBox = [&](const FIntVector& Min, const FIntVector& Max, const float Distance)
+		{
+			for (auto i = FMath::Max(Min.X, 0); i <= FMath::Min(Max.X, LevelSize.X - 1); ++i)
+			{
+				for (auto j = FMath::Max(Min.Y, 0); j <= FMath::Min(Max.Y, LevelSize.Y - 1); ++j)
+				{
+					for (auto k = FMath::Max(Min.Z, 0); k <= FMath::Min(Max.Z, LevelSize.Z - 1); ++k)
+					{
+						const auto CellIndex = FindCellIndex(FIntVector(i, j, k), Level);
+						if (CellIndex == INDEX_NONE) continue;
+						const auto bBorder = bOverflow &&
+											 ((i == 0) || (i == LevelSize.X - 1) ||
+											  (j == 0) || (j == LevelSize.Y - 1) ||
+											  (!bPlanar && ((k == 0) || (k == LevelSize.Z - 1))));
+						if (!FBubbleCageKernel::Visit(Functor, CellIndex, bBorder ? 0.0f : Distance))
+						{
+							return false;
+						}
+					}
+				}
+			}
+			return true;
+		};
+
+		// The whole cube around the entry cell...
+		if (!VisitBox(Cell - FIntVector(Reach), Cell + FIntVector(Reach), DistanceMin))
+		{
+			return false;
+		}
+		while (true)
+		{
+			const auto Axis = (DistanceNext.X < DistanceNext.Y)
+							? ((DistanceNext.X < DistanceNext.Z) ? 0 : 2)
+							: ((DistanceNext.Y < DistanceNext.Z) ? 1 : 2);
+			const auto Distance = DistanceNext[Axis];
+			if (Distance > DistanceMax) break;
+			Cell[Axis] += Step[Axis];
+			DistanceNext[Axis] += DistanceDelta[Axis];
+			// Only the leading face of the cube is new...
+			auto FaceMin = Cell - FIntVector(Reach);
+			auto FaceMax = Cell + FIntVector(Reach);
+			FaceMin[Axis] = FaceMax[Axis] = Cell[Axis] + Step[Axis] * Reach;
+			if (!VisitBox(FaceMin, FaceMax, Distance))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Cast a sphere through the cage, optionally filtering the bubbles.
+	 * 
+	 * @param Start The global start of the cast.
+	 * @param End The global end of the cast.
+	 * @param Radius The radius of the sphere. Zero for a segment.
+	 * @param Filter The filter to narrow by. Only used if @p bFiltered.
+	 * @param LayerMask The collision layers to narrow by.
+	 * @param OutHit The closest hit. Only used if @p OutHits is @c nullptr.
+	 * @param OutHits All the hits sorted by their distance, if not @c nullptr.
+	 * @return Was anything hit.
+	 */
+	template < bool bFiltered >
+	bool
+	DoSphereCast(const FVector&          Start,
+				 const FVector&          End,
+				 const float             Radius,
+				 const FFilter*          Filter,
+				 const uint32            LayerMask,
+				 FBubbleCageHit*         OutHit,
+				 TArray<FBubbleCageHit>* OutHits) const;
+
+	/**
+	 * Find the nearest bubbles, optionally filtering them.
+	 * 
+	 * @param Location The global location to search around.
+	 * @param K The maximum number of the bubbles to find.
+	 * @param Filter The filter to narrow by. Only used if @p bFiltered.
+	 * @param LayerMask The collision layers to narrow by.
+	 * @param MaxRadius The maximum distance to the centers of the bubbles.
+	 * @param OutNearest The storage for at least @p K bubbles
+	 * to receive the nearest ones sorted by their distance.
+	 * @return The number of the bubbles found.
+	 */
+	template < bool bFiltered >
+	int32
+	DoGetNearest(const FVector&  Location,
+				 const int32     K,
+				 const FFilter*  Filter,
+				 const uint32    LayerMask,
+				 const float     MaxRadius,
+				 FSubjectHandle* OutNearest) const;
+
+	/**
+	 * Find the nearest bubbles for a batch of locations,
+	 * optionally filtering them.
+	 */
+	template < bool bFiltered >
+	int32
+	DoGetNearestBatch(TArrayView<const FVector> Locations,
+					  const int32               K,
+					  const FFilter*            Filter,
+					  const uint32              LayerMask,
+					  const float               MaxRadius,
+					  TArray<FSubjectHandle>&   OutNearest,
+					  TArray<int32>&            OutOffsets) const;
+
+	/**
+	 * Get the bubbles overlapping a convex region,
+	 * optionally filtering them.
+	 * 
+	 * The blocks of cells are classified against the region
+	 * recursively. The blocks fully outside of the region are skipped,
+	 * while the subjects of the blocks fully inside of it are gathered
+	 * without testing each of the bubbles.
+	 * 
+	 * @tparam RegionT The type of the region.
+	 * @param Region The region to test against.
+	 * @param Filter The filter to narrow by. Only used if @p bFiltered.
+	 * @param OutOverlappers The overlapping bubbles.
+	 * @return The number of the overlapping bubbles.
+	 */
+	template < bool bFiltered, typename RegionT >
+	int32
+	DoGetOverlappingRegion(const RegionT&          Region,
+						   const FFilter*          Filter,
+						   TArray<FSubjectHandle>& OutOverlappers) const;
+
+	/**
+	 * Update the snapshot of a packed subject's location.
+	 */
+	FORCEINLINE void
+	SetPackedLocation(const int32 PackedIndex, const FVector& Location)
+	{
+		const auto LocalLocation = FVector3f(WorldToBounded(Location));
+		PackedLocationsX[PackedIndex] = LocalLocation.X;
+		PackedLocationsY[PackedIndex] = LocalLocation.Y;
+		PackedLocationsZ[PackedIndex] = LocalLocation.Z;
+	}
+
+	/**
+	 * Fill the cage via the parallel counting sort.
+	 */
+	void
+	UpdatePacked();
+
+	/**
+	 * Check if the decoupling is done on a pair basis.
+	 */
+	FORCEINLINE bool
+	IsPairwise() const
+	{
+		return bDecouplePairwise && IsPacked() && !bDeterministic && !bPlanar &&
+			   (BoundsPolicy != EBubbleCageBoundsPolicy::Wrap);
+	}
+
+	/**
+	 * Sort the subjects within each of the occupied cells
+	 * by their identifiers.
+	 * 
+	 * The packed snapshots and indices get reordered accordingly.
+	 */
+	void
+	SortCells();
+
+	/**
+	 * Check if the contacts are to be gathered
+	 * during the current decoupling.
+	 */
+	FORCEINLINE bool
+	IsGatheringContacts() const
+	{
+		return bTrackContacts && bFirstPass;
+	}
+
+	/**
+	 * Prepare for the gathering of the contacts.
+	 */
+	void
+	BeginContacts();
+
+	/**
+	 * Register a contact in a thread-safe manner.
+	 */
+	FORCEINLINE void
+	AddContact(const FSubjectHandle& SubjectA,
+			   const FSubjectHandle& SubjectB)
+	{
+		const auto Index = ContactsCursor.fetch_add(1, std::memory_order_relaxed);
+		if (LIKELY(Index < GatheredContacts.Num()))
+		{
+			GatheredContacts[Index] = FBubbleCageContact(SubjectA, SubjectB);
+			return;
+		}
+		FScopeLock Lock(&OverflowContactsLock);
+		OverflowContacts.Emplace(SubjectA, SubjectB);
+	}
+
+	/**
+	 * Compare the gathered contacts with the previous
+	 * ones to get the began, persisting and ended ones.
+	 */
+	void
+	EndContacts();
+
+	/**
+	 * Detect the coupled pairs, accumulating
+	 * the decouples into the pairwise buffers.
+	 */
+	void
+	DetectPairwise();
+
+	/**
+	 * Check if the collisions are detected within the shards.
+	 */
+	FORCEINLINE bool
+	IsSharded() const
+	{
+		return (ShardsCount > 1) && IsPacked() && !bSparseCells && !bMortonCells && (GetLevelsNum() == 1) &&
+			   !bPlanar && (BoundsPolicy != EBubbleCageBoundsPolicy::Wrap);
+	}
+
+	/**
+	 * Detect the collisions shard by shard, gathering
+	 * the decouples of each of the bubbles into the first
+	 * of the pairwise buffers.
+	 */
+	void
+	DetectSharded();
+
+	/**
+	 * Check if the bubbles may fall asleep.
+	 */
+	FORCEINLINE bool
+	IsSleeping() const
+	{
+		return SleepEvaluationsCount > 0;
+	}
+
+	/**
+	 * Check if a bubble is asleep.
+	 */
+	FORCEINLINE bool
+	IsAsleep(const FBubbleSphere& BubbleSphere) const
+	{
+		return IsSleeping() && (BubbleSphere.RestingCount >= SleepEvaluationsCount);
+	}
+
+	/**
+	 * Check if a subject is an asleep bubble.
+	 */
+	FORCEINLINE bool
+	IsAsleep(const FSubjectHandle& Subject) const
+	{
+		if (!IsSleeping()) return false;
+		static const auto Filter = FFilter::Make<FLocated, FBubbleSphere>();
+		auto Bubble = (FSolidSubjectHandle)Subject;
+		return Bubble && Bubble.Matches(Filter) && IsAsleep(Bubble.GetTraitRef<FBubbleSphere>());
+	}
+
+	/**
+	 * Count the evaluations a bubble has been resting for.
+	 * 
+	 * The count is reset as soon as the bubble
+	 * drifts away from its rest location.
+	 */
+	FORCEINLINE void
+	TrackRest(FBubbleSphere& BubbleSphere, const FVector& Location) const
+	{
+		const auto LocalLocation = FVector3f(WorldToBounded(Location));
+		if ((LocalLocation - BubbleSphere.RestLocation).SizeSquared() > FMath::Square(SleepTolerance))
+		{
+			BubbleSphere.RestLocation = LocalLocation;
+			BubbleSphere.RestingCount = 0;
+			return;
+		}
+		BubbleSphere.RestingCount = FMath::Min(BubbleSphere.RestingCount + 1, SleepEvaluationsCount);
+	}
+
+	/**
+	 * Wake the sleeping subjects that got into contact
+	 * with the moving ones.
+	 */
+	void
+	WakeSubjects();
+
+	/**
+	 * Sweep a bubble from its previous location to the current one.
+	 * 
+	 * The bubbles overlapping at the start of the sweep
+	 * are left to the regular decoupling.
+	 * 
+	 * @param Subject The subject of the bubble.
+	 * @param Located The location trait of the subject.
+	 * @param BubbleSphere The bubble trait of the subject.
+	 * Receives the decouple rewinding it to the first impact.
+	 * @return Was anything hit along the way.
+	 */
+	bool
+	Sweep(const FSubjectHandle& Subject,
+		  const FLocated&       Located,
+		  FBubbleSphere&        BubbleSphere) const;
+
+	/**
+	 * Mark the bubble as the one that has to be decoupled.
+	 */
+	template < bool bUseTrait >
+	FORCEINLINE void
+	MarkCoupled(FSolidSubjectHandle Bubble,
+				FLocated&           Located,
+				FBubbleSphere&      BubbleSphere)
+	{
+		if (bUseTrait) // Compile-time branch
+		{
+			Bubble.SetTraitDeferred(FCoupling{});
+		}
+		else
+		{
+			CoupledSubjects.Enqueue(FCouplingEntry((FSubjectHandle)Bubble, &Located, &BubbleSphere));
+		}
+	}
+
+	/**
+	 * Displace a coupled bubble by its accumulated decouple.
+	 * 
+	 * The bubble gets moved to its new cell if needed.
+	 * This method is thread-safe.
+	 * 
+	 * @param Subject The subject of the bubble.
+	 * @param Located The location trait of the subject.
+	 * @param BubbleSphere The bubble trait of the subject.
+	 * @param LargestDisplacement The largest displacement
+	 * among the packed bubbles to update.
+	 */
+	FORCEINLINE void
+	ApplyDecouple(FSubjectHandle      Subject,
+				  FLocated&           Located,
+				  FBubbleSphere&      BubbleSphere,
+				  std::atomic<float>& LargestDisplacement)
+	{
+		const auto Displacement = BubbleSphere.AccumulatedDecouple /
+								  BubbleSphere.AccumulatedDecoupleCount;
+		Located.Location += Displacement;
+		BubbleSphere.AccumulatedDecouple = FVector::ZeroVector;
+		BubbleSphere.AccumulatedDecoupleCount = 0;
+
+		if (UNLIKELY(!IsInside(Located.Location) && !ConfineToBounds(Located.Location)))
+		{
+			// We can't despawn normally here, since it will
+			// screw up the direct trait references.
+			Subject.DespawnDeferred();
+			return;
+		}
+
+		if (bSweptDecoupling)
+		{
+			BubbleSphere.SweptLocation = FVector3f(WorldToBounded(Located.Location));
+		}
+
+		if (IsPacked())
+		{
+			// The packed cells are immutable until the next update,
+			// while a copied or a stale trait may point elsewhere...
+			const auto PackedIndex = BubbleSphere.PackedIndex;
+			if (LIKELY(PackedSubjects.IsValidIndex(PackedIndex) && (PackedSubjects[PackedIndex] == Subject)))
+			{
+				SetPackedLocation(PackedIndex, Located.Location);
+			}
+			AtomicMax(LargestDisplacement, Displacement.Size());
+			return;
+		}
+
+		BubbleSphere.CageLocation = FVector3f(WorldToBounded(Located.Location));
+		const auto NewCellIndex = GetIndexAt(Located.Location);
+		if (BubbleSphere.CellIndex != NewCellIndex)
+		{
+			MoveToCell(Subject, BubbleSphere, NewCellIndex);
+		}
+		else
+		{
+			RefreshInCell(Subject, BubbleSphere);
+		}
+	}
+
+	/**
+	 * Move only the subjects that have changed their cells.
+	 */
+	void
+	UpdateIncrementally();
+
+	/**
+	 * Purge the despawned subjects from the cells
+	 * and rebuild the fingerprints and the layers of the cells.
+	 */
+	void
+	CompactCells();
+
+	/**
+	 * Dequeue the unique indices of the occupied cells.
+	 * 
+	 * The caller is responsible for enqueuing
+	 * the still occupied ones back.
+	 */
+	void
+	DequeueOccupiedCells(TArray<int32>& OutOccupied);
+
+	/**
+	 * Make the snapshot of a bubble for the unpacked cells.
+	 */
+	static FORCEINLINE FBubbleCageOccupant
+	MakeCellOccupant(const FBubbleSphere& BubbleSphere)
+	{
+		FBubbleCageOccupant Occupant;
+		Occupant.Location = BubbleSphere.CageLocation;
+		Occupant.Radius = BubbleSphere.Radius;
+		Occupant.DecoupleProportion = BubbleSphere.DecoupleProportion;
+		Occupant.Layers = (uint32)BubbleSphere.CollisionLayers;
+		Occupant.Mask = (uint32)BubbleSphere.CollisionMask;
+		return Occupant;
+	}
+
+	/**
+	 * Refresh the snapshot of a subject staying
+	 * within its cell in a thread-safe manner.
+	 */
+	FORCEINLINE void
+	RefreshInCell(const FSubjectHandle Subject,
+				  const FBubbleSphere& BubbleSphere)
+	{
+		auto& Cell = Cells[BubbleSphere.CellIndex];
+		Cell.Lock();
+		// The slot is only changed under the lock of the cell...
+		const auto Slot = BubbleSphere.CellSlot;
+		if (LIKELY((Slot >= 0) && (Slot < Cell.Subjects.Num()) && (Cell.Subjects[Slot] == Subject)))
+		{
+			Cell.Occupants[Slot] = MakeCellOccupant(BubbleSphere);
+		}
+		Cell.Unlock();
+	}
+
+	/**
+	 * Remove a subject from a locked cell by its slot.
+	 * 
+	 * The last subject of the cell takes its place,
+	 * so the slot of that one is updated accordingly.
+	 */
+	FORCEINLINE void
+	RemoveFromCell(FBubbleCageCell& Cell, const int32 Slot)
+	{
+		Cell.RemoveAt(Slot);
+		if (Slot < Cell.Subjects.Num())
+		{
+			SetCellSlot(Cell.Subjects[Slot], Slot);
+		}
+	}
+
+	/**
+	 * Update the slot of a subject within its unpacked cell.
+	 */
+	static FORCEINLINE void
+	SetCellSlot(const FSubjectHandle& Subject, const int32 Slot)
+	{
+		static const auto Filter = FFilter::Make<FLocated, FBubbleSphere>();
+		auto Bubble = (FSolidSubjectHandle)Subject;
+		if (LIKELY(Bubble && Bubble.Matches(Filter)))
+		{
+			Bubble.GetTraitRef<FBubbleSphere>().CellSlot = Slot;
+		}
+	}
+
+	/**
+	 * Move a subject to a new cell in a thread-safe manner.
+	 * 
+	 * @param Subject The subject to move.
+	 * @param BubbleSphere The bubble trait of the subject.
+	 * @param NewCellIndex The index of the cell to move to.
+	 */
+	FORCEINLINE void
+	MoveToCell(const FSubjectHandle Subject,
+			   FBubbleSphere&       BubbleSphere,
+			   const int32          NewCellIndex)
+	{
+		if (BubbleSphere.CellIndex != INDEX_NONE)
+		{
+			auto& FormerCell = Cells[BubbleSphere.CellIndex];
+			FormerCell.Lock();
+			const auto Slot = BubbleSphere.CellSlot;
+			const auto bRemoved = (Slot >= 0) && (Slot < FormerCell.Subjects.Num()) && (FormerCell.Subjects[Slot] == Subject);
+			if (LIKELY(bRemoved))
+			{
+				RemoveFromCell(FormerCell, Slot);
+			}
+			FormerCell.Unlock();
+			if (bRemoved)
+			{
+				CellOccupantsNum.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+		BubbleSphere.CellIndex = NewCellIndex;
+		BubbleSphere.CellSlot = INDEX_NONE;
+		if (NewCellIndex == INDEX_NONE) return;
+		auto& NewCell = Cells[NewCellIndex];
+		NewCell.Lock();
+		const auto Index = NewCell.Add(Subject, MakeCellOccupant(BubbleSphere));
+		BubbleSphere.CellSlot = Index;
+		NewCell.Fingerprint.Add(Subject.GetFingerprint());
+		NewCell.Layers |= BubbleSphere.CollisionLayers;
+		NewCell.Unlock();
+		CellOccupantsNum.fetch_add(1, std::memory_order_relaxed);
+		if (Index == 0)
+		{
+			OccupiedCells.Enqueue(NewCellIndex);
+		}
+	}
+
+#pragma region UActorComponent
+
+	void
+	InitializeComponent() override;
+
+	void
+	ApplyWorldOffset(const FVector& InOffset, bool bWorldShift) override;
+
+#pragma endregion UActorComponent
+
+
+  public:
+
+#pragma region Debugging
+	/// @name Debugging
+	/// @{
+
+#if WITH_EDITORONLY_DATA
+
+	/**
+	 * Should individual cage cells be drawn in the debugging mode.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Debugging")
+	bool bDebugDrawCageCells = false;
+
+#endif // WITH_EDITORONLY_DATA
+
+	/// @}
+#pragma endregion Debugging
+
+	/**
+	 * Initialize the defaults for the bubble cage component.
+	 */
+	UBubbleCageComponent();
+
+	/**
+	 * Get the size of a single cell in global units.
+	 */
+	const auto
+	GetCellSize() const
+	{
+		return CellSize;
+	}
+
+	/**
+	 * Get the size of the cage in cells among each axis.
+	 */
+	const FIntVector&
+	GetSize() const
+	{
+		return Size;
+	}
+
+	/**
+	 * Get the global bounds of the cage in world units.
+	 */
+	const FBox&
+	GetBounds() const
+	{
+		if (bInitialized)
+		{
+			return Bounds;
+		}
+		const auto Extents = CellSize * FVector(Size) * 0.5f;
+		const auto Actor = GetOwner();
+		const auto Location = (Actor != nullptr) ? Actor->GetActorLocation() : FVector::ZeroVector;
+		Bounds.Min = Location - Extents;
+		Bounds.Max = Location + Extents;
+		return Bounds;
+	}
+
+	/**
+	 * Convert a global 3D location to a position within the cage.
+	 * 
+	 * No bounding checks are performed.
+	 */
+	FORCEINLINE FIntVector
+	WorldToCage(FVector Point) const
+	{
+		Point -= Bounds.Min;
+		Point *= InvCellSizeCache;
+		return FIntVector(FMath::FloorToInt(Point.X),
+						  FMath::FloorToInt(Point.Y),
+						  FMath::FloorToInt(Point.Z));
+	}
+
+	/**
+	 * Convert a global 3D location to a position within a level of the cage.
+	 * 
+	 * No bounding checks are performed.
+	 */
+	FORCEINLINE FIntVector
+	WorldToCage(const FVector& Point, const int32 Level) const
+	{
+		const auto CellPoint = WorldToCage(Point);
+		return FIntVector(CellPoint.X >> Level,
+						  CellPoint.Y >> Level,
+						  CellPoint.Z >> Level);
+	}
+
+	/**
+	 * Convert a global 3D location to a position within the bounds.
+	 * 
+	 * No bounding checks are performed.
+	 */
+	FORCEINLINE FVector
+	WorldToBounded(const FVector& Point) const
+	{
+		return Point - Bounds.Min;
+	}
+
+	/**
+	 * Convert a position within the bounds to a global 3D location.
+	 */
+	FORCEINLINE FVector
+	BoundedToWorld(const FVector3f& Point) const
+	{
+		return Bounds.Min + FVector(Point);
+	}
+
+	/**
+	 * Move the cage, leaving the bubbles in place.
+	 * 
+	 * The bubbles are stored relative to the cage
+	 * in a single precision, so keep the cage near the
+	 * action on the large worlds. The cage-local snapshots
+	 * are re-derived, while the filled cage gets updated,
+	 * so the bubbles get re-binned.
+	 * 
+	 * @param Offset The offset to move the cage by.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void
+	Rebase(const FVector& Offset);
+
+  private:
+
+	/**
+	 * Move the cage along with all of its bubbles.
+	 * 
+	 * The cage-local snapshots stay valid,
+	 * so no re-registration is needed.
+	 * 
+	 * @param Offset The offset to move by.
+	 */
+	void
+	ShiftWorld(const FVector& Offset);
+
+  public:
+
+	/**
+	 * Convert a cage-local 3D location to a position within the cage.
+	 * 
+	 * No bounding checks are performed.
+	 */
+	FORCEINLINE FIntVector
+	BoundedToCage(FVector Point) const
+	{
+		Point *= InvCellSizeCache;
+		return FIntVector(FMath::FloorToInt(Point.X),
+						  FMath::FloorToInt(Point.Y),
+						  FMath::FloorToInt(Point.Z));
+	}
+
+	/**
+	 * The number of bits per axis within a single Morton brick.
+	 */
+	static constexpr int32 MortonBrickBits = 3;
+
+	/**
+	 * Interleave the brick-local bits of a coordinate.
+	 */
+	static FORCEINLINE int32
+	SpreadMortonBits(const int32 Coordinate)
+	{
+		static constexpr int32 Spread[1 << MortonBrickBits] = {0, 1, 8, 9, 64, 65, 72, 73};
+		return Spread[Coordinate & ((1 << MortonBrickBits) - 1)];
+	}
+
+	/**
+	 * Gather back the brick-local bits of a coordinate.
+	 */
+	static FORCEINLINE int32
+	CompactMortonBits(const int32 Bits)
+	{
+		return (Bits & 1) | ((Bits >> 2) & 2) | ((Bits >> 4) & 4);
+	}
+
+	/**
+	 * Get the number of Morton bricks along each of the axes.
+	 */
+	static FORCEINLINE FIntVector
+	GetMortonBricksNum(const FIntVector& LevelSize)
+	{
+		static constexpr int32 BrickMask = (1 << MortonBrickBits) - 1;
+		return FIntVector((LevelSize.X + BrickMask) >> MortonBrickBits,
+						  (LevelSize.Y + BrickMask) >> MortonBrickBits,
+						  (LevelSize.Z + BrickMask) >> MortonBrickBits);
+	}
+
+	/**
+	 * Get the number of the dense cells
+	 * occupied by a level of the specified size,
+	 * respecting the current layout.
+	 */
+	FORCEINLINE int64
+	GetLayoutVolume(const FIntVector& LevelSize) const
+	{
+		if (bMortonCells)
+		{
+			const auto BricksNum = GetMortonBricksNum(LevelSize);
+			return ((int64)BricksNum.X * (int64)BricksNum.Y * (int64)BricksNum.Z) << (3 * MortonBrickBits);
+		}
+		return (int64)LevelSize.X * (int64)LevelSize.Y * (int64)LevelSize.Z;
+	}
+
+	/**
+	 * Get the level-local index of a dense cell
+	 * respecting the current layout.
+	 * 
+	 * No bounding checks are performed.
+	 */
+	FORCEINLINE int32
+	GetLayoutIndex(const FIntVector& LevelSize, const int32 X, const int32 Y, const int32 Z) const
+	{
+		if (bMortonCells)
+		{
+			const auto BricksNum = GetMortonBricksNum(LevelSize);
+			const auto Brick = (X >> MortonBrickBits)
+							 + BricksNum.X * ((Y >> MortonBrickBits) + BricksNum.Y * (Z >> MortonBrickBits));
+			return (Brick << (3 * MortonBrickBits))
+				 | SpreadMortonBits(X)
+				 | (SpreadMortonBits(Y) << 1)
+				 | (SpreadMortonBits(Z) << 2);
+		}
+		return X + LevelSize.X * (Y + LevelSize.Y * Z);
+	}
+
+	/**
+	 * Get the position of a dense cell within its level
+	 * by its level-local index, respecting the current layout.
+	 */
+	FORCEINLINE FIntVector
+	GetLayoutPoint(const FIntVector& LevelSize, const int32 Index) const
+	{
+		if (bMortonCells)
+		{
+			const auto BricksNum = GetMortonBricksNum(LevelSize);
+			const auto Brick = Index >> (3 * MortonBrickBits);
+			const auto Local = Index & ((1 << (3 * MortonBrickBits)) - 1);
+			const auto BricksLayer = BricksNum.X * BricksNum.Y;
+			const auto BrickPadding = Brick % BricksLayer;
+			return FIntVector(((BrickPadding % BricksNum.X) << MortonBrickBits) | CompactMortonBits(Local),
+							  ((BrickPadding / BricksNum.X) << MortonBrickBits) | CompactMortonBits(Local >> 1),
+							  ((Brick / BricksLayer) << MortonBrickBits) | CompactMortonBits(Local >> 2));
+		}
+		const auto LayerSize = LevelSize.X * LevelSize.Y;
+		const auto LayerPadding = Index % LayerSize;
+		return FIntVector(LayerPadding % LevelSize.X, LayerPadding / LevelSize.X, Index / LayerSize);
+	}
+
+	/* Get the index of the cage cell. */
+	FORCEINLINE int32
+	GetIndexAt(int32 X, int32 Y, int32 Z) const
+	{
+		X = FMath::Clamp(X, 0, Size.X - 1);
+		Y = FMath::Clamp(Y, 0, Size.Y - 1);
+		Z = FMath::Clamp(Z, 0, Size.Z - 1);
+		return GetLayoutIndex(Size, X, Y, Z);
+	}
+
+	/**
+	 * Find the index of a cell by its position in the cage.
+	 * 
+	 * Unlike GetIndexAt(), no clamping is performed and
+	 * the sparse cells are respected as well.
+	 * 
+	 * @return The index of the cell or @c INDEX_NONE,
+	 * if the position is outside of the cage or
+	 * there is no such sparse cell occupied.
+	 */
+	FORCEINLINE int32
+	FindCellIndex(const FIntVector& CellPoint) const
+	{
+		return FindCellIndex(CellPoint, 0);
+	}
+
+	/**
+	 * Find the index of a cell by its position within a level.
+	 * 
+	 * @return The index of the cell or @c INDEX_NONE,
+	 * if the position is outside of the level or
+	 * there is no such sparse cell occupied.
+	 */
+	FORCEINLINE int32
+	FindCellIndex(const FIntVector& CellPoint, const int32 Level) const
+	{
+		const auto LevelSize = GetLevelSize(Level);
+		if (UNLIKELY((CellPoint.X < 0) || (CellPoint.X >= LevelSize.X) ||
+					 (CellPoint.Y < 0) || (CellPoint.Y >= LevelSize.Y) ||
+					 (CellPoint.Z < 0) || (CellPoint.Z >= LevelSize.Z)))
+		{
+			return INDEX_NONE;
+		}
+		if (bSparseCells)
+		{
+			return FindSparseCell(MakeSparseKey(CellPoint, Level));
+		}
+		return LevelBases[Level] + GetLayoutIndex(LevelSize, CellPoint.X, CellPoint.Y, CellPoint.Z);
+	}
+
+	/**
+	 * Iterate the bubbles overlapping a sphere.
+	 * 
+	 * This is the zero-allocation version of GetOverlapping()
+	 * with the functor being inlined right into the narrow phase.
+	 * 
+	 * @tparam bFiltered Should the filter be respected.
+	 * @param Location The global center of the sphere.
+	 * @param Radius The radius of the sphere.
+	 * @param Filter The filter to narrow by. Only used if @p bFiltered.
+	 * @param LayerMask The collision layers to narrow by.
+	 * @param Functor The functor to call for each of the overlapping
+	 * bubbles with its subject handle, its global location, its radius
+	 * and the squared distance to it. May return @c false to stop the iterating.
+	 * @return Was the iterating completed without an early-out.
+	 */
+	template < bool bFiltered, typename FunctorT >
+	FORCEINLINE bool
+	DoForEachOverlapping(const FVector& Location,
+						 const float    Radius,
+						 const FFilter* Filter,
+						 const uint32   LayerMask,
+						 FunctorT&&     Functor) const
+	{
+		return ForEachImage(Location, Radius + LargestRadius + DisplacementSlack, [&](const FVector& Image)
+		{
+			const auto LocalLocation = FVector3f(WorldToBounded(Image));
+			return ForEachCellNear(Image, Radius, [&](const int32 CellIndex)
+			{
+				if (!MatchesCell<bFiltered>(CellIndex, Filter, LayerMask)) return true;
+				return ForEachOverlappingIn(CellIndex, LocalLocation, Radius,
+				[&](const FOccupant& Occupant)
+				{
+					if (UNLIKELY(!MatchesOccupant<bFiltered>(Occupant, Filter, LayerMask))) return true;
+					return FBubbleCageKernel::Visit(Functor,
+													(const FSubjectHandle&)Occupant.Subject,
+													BoundedToWorld(Occupant.Location),
+													Occupant.Radius,
+													(LocalLocation - Occupant.Location).SizeSquared());
+				});
+			});
+		});
+	}
+
+	/**
+	 * Iterate the bubbles overlapping a sphere.
+	 * 
+	 * No allocations are performed here.
+	 * 
+	 * @param Location The global center of the sphere.
+	 * @param Radius The radius of the sphere.
+	 * @param Functor The functor to call for each of the overlapping
+	 * bubbles with its subject handle, its global location, its radius
+	 * and the squared distance to it. May return @c false to stop the iterating.
+	 * @return Was the iterating completed without an early-out.
+	 */
+	template < typename FunctorT >
+	FORCEINLINE bool
+	ForEachOverlapping(const FVector& Location,
+					   const float    Radius,
+					   FunctorT&&     Functor) const
+	{
+		return DoForEachOverlapping<false>(Location, Radius, nullptr, AllLayers, Forward<FunctorT>(Functor));
+	}
+
+	/**
+	 * Iterate the bubbles overlapping a sphere and matching a filter.
+	 * 
+	 * No allocations are performed here.
+	 * 
+	 * @param Location The global center of the sphere.
+	 * @param Radius The radius of the sphere.
+	 * @param Filter The filter to narrow by.
+	 * @param Functor The functor to call for each of the overlapping
+	 * bubbles with its subject handle, its global location, its radius
+	 * and the squared distance to it. May return @c false to stop the iterating.
+	 * @return Was the iterating completed without an early-out.
+	 */
+	template < typename FunctorT >
+	FORCEINLINE bool
+	ForEachOverlapping(const FVector& Location,
+					   const float    Radius,
+					   const FFilter& Filter,
+					   FunctorT&&     Functor) const
+	{
+		return DoForEachOverlapping<true>(Location, Radius, &Filter, AllLayers, Forward<FunctorT>(Functor));
+	}
+
+	/**
+	 * Iterate the bubbles overlapping a sphere
+	 * and belonging to any of the collision layers.
+	 * 
+	 * The cells and the bubbles are rejected by a single
+	 * bitwise test each, so the negative filters like
+	 * "everything except X" are supported as well.
+	 * No allocations are performed here.
+	 * 
+	 * @param Location The global center of the sphere.
+	 * @param Radius The radius of the sphere.
+	 * @param LayerMask The collision layers to narrow by.
+	 * @param Functor The functor to call for each of the overlapping
+	 * bubbles with its subject handle, its global location, its radius
+	 * and the squared distance to it. May return @c false to stop the iterating.
+	 * @return Was the iterating completed without an early-out.
+	 */
+	template < typename FunctorT >
+	FORCEINLINE bool
+	ForEachOverlapping(const FVector& Location,
+					   const float    Radius,
+					   const int32    LayerMask,
+					   FunctorT&&     Functor) const
+	{
+		return DoForEachOverlapping<false>(Location, Radius, nullptr, (uint32)LayerMask, Forward<FunctorT>(Functor));
+	}
+
+	/**
+	 * Get overlapping spheres for the specified location.
+	 */
+	int32
+	GetOverlapping(const FVector&          Location,
+				   TArray<FSubjectHandle>& OutOverlappers) const
+	{
+		return GetOverlapping(Location, 0.0f, OutOverlappers);
 	}
 
 	/**
@@ -337,47 +2398,7 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 				   const FFilter&          Filter,
 				   TArray<FSubjectHandle>& OutOverlappers) const
 	{
-		OutOverlappers.Reset();
-		const auto Range = FVector(LargestRadius);
-		const auto CagePosMin = WorldToCage(Location - Range);
-		const auto CagePosMax = WorldToCage(Location + Range);
-		for (auto i = CagePosMin.X; i <= CagePosMax.X; ++i)
-		{
-			for (auto j = CagePosMin.Y; j <= CagePosMax.Y; ++j)
-			{
-				for (auto k = CagePosMin.Z; k <= CagePosMax.Z; ++k)
-				{
-					const auto NeighbourCellPos = FIntVector(i, j, k);
-					if (LIKELY(IsInside(NeighbourCellPos)))
-					{
-						const auto& NeighbourCell = At(NeighbourCellPos);
-						// Negative filtering can't be performed here,
-						// since the cell's fingerprint includes a sum of internals.
-						if (NeighbourCell.Fingerprint.Matches(Filter.GetFingerprint()))
-						{
-							for (int32 t = 0; t < NeighbourCell.Subjects.Num(); ++t)
-							{
-								const auto OtherBubble = NeighbourCell.Subjects[t];
-								if (LIKELY(OtherBubble.Matches(Filter)))
-								{
-									const auto OtherBubbleSphere =
-										OtherBubble.GetTrait<FBubbleSphere>();
-									const auto OtherLocation =
-										OtherBubble.GetTrait<FLocated>().GetLocation();
-									const auto Delta = Location - OtherLocation;
-									const float DistanceSqr = Delta.SizeSquared();
-									if (FMath::Square(OtherBubbleSphere.Radius) > DistanceSqr)
-									{
-										OutOverlappers.Add(OtherBubble);
-									}
-								}
-							}
-						}
-					}
-				}
-			}
-		}
-		return OutOverlappers.Num();
+		return GetOverlapping(Location, 0.0f, Filter, OutOverlappers);
 	}
 
 	/**
@@ -388,46 +2409,12 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 				   const float             Radius,
 				   TArray<FSubjectHandle>& OutOverlappers) const
 	{
-		if (UNLIKELY(Radius == 0))
-		{
-			return GetOverlapping(Location, OutOverlappers);
-		}
-
 		OutOverlappers.Reset();
-		const auto Range = FVector(Radius + LargestRadius);
-		const auto CagePosMin = WorldToCage(Location - Range);
-		const auto CagePosMax = WorldToCage(Location + Range);
-		for (auto i = CagePosMin.X; i <= CagePosMax.X; ++i)
+		ForEachOverlapping(Location, Radius,
+		[&](const FSubjectHandle& Subject, const FVector&, const float, const float)
 		{
-			for (auto j = CagePosMin.Y; j <= CagePosMax.Y; ++j)
-			{
-				for (auto k = CagePosMin.Z; k <= CagePosMax.Z; ++k)
-				{
-					const auto NeighbourCellPos = FIntVector(i, j, k);
-					if (LIKELY(IsInside(NeighbourCellPos)))
-					{
-						const auto& NeighbourCell = At(NeighbourCellPos);
-						for (int32 t = 0; t < NeighbourCell.Subjects.Num(); ++t)
-						{
-							const auto OtherBubble = NeighbourCell.Subjects[t];
-							if (LIKELY(OtherBubble))
-							{
-								const auto OtherBubbleSphere =
-									OtherBubble.GetTrait<FBubbleSphere>();
-								const auto OtherLocation =
-									OtherBubble.GetTrait<FLocated>().GetLocation();
-								const auto Delta = Location - OtherLocation;
-								const auto DistanceSqr = Delta.SizeSquared();
-								if (FMath::Square(Radius + OtherBubbleSphere.Radius) > DistanceSqr)
-								{
-									OutOverlappers.Add(OtherBubble);
-								}
-							}
-						}
-					}
-				}
-			}
-		}
+			OutOverlappers.Add(Subject);
+		});
 		return OutOverlappers.Num();
 	}
 
@@ -441,51 +2428,38 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 				   const FFilter&          Filter,
 				   TArray<FSubjectHandle>& OutOverlappers) const
 	{
-		if (UNLIKELY(Radius == 0))
+		OutOverlappers.Reset();
+		ForEachOverlapping(Location, Radius, Filter,
+		[&](const FSubjectHandle& Subject, const FVector&, const float, const float)
 		{
-			return GetOverlapping(Location, Filter, OutOverlappers);
-		}
+			OutOverlappers.Add(Subject);
+		});
+		return OutOverlappers.Num();
+	}
 
+	/**
+	 * Get overlapping spheres belonging
+	 * to any of the collision layers.
+	 * 
+	 * @param Location The global center of the sphere.
+	 * @param Radius The radius of the sphere.
+	 * @param LayerMask The collision layers to narrow by.
+	 * @param OutOverlappers The overlapping bubbles.
+	 * @return The number of the overlapping bubbles.
+	 */
+	UFUNCTION(BlueprintCallable)
+	int32
+	GetOverlappingInLayers(const FVector&          Location,
+						   const float             Radius,
+						   UPARAM(Meta = (Bitmask)) const int32 LayerMask,
+						   TArray<FSubjectHandle>& OutOverlappers) const
+	{
 		OutOverlappers.Reset();
-		const auto Range = FVector(Radius + LargestRadius);
-		const auto CagePosMin = WorldToCage(Location - Range);
-		const auto CagePosMax = WorldToCage(Location + Range);
-		for (auto i = CagePosMin.X; i <= CagePosMax.X; ++i)
+		ForEachOverlapping(Location, Radius, LayerMask,
+		[&](const FSubjectHandle& Subject, const FVector&, const float, const float)
 		{
-			for (auto j = CagePosMin.Y; j <= CagePosMax.Y; ++j)
-			{
-				for (auto k = CagePosMin.Z; k <= CagePosMax.Z; ++k)
-				{
-					const auto NeighbourCellPos = FIntVector(i, j, k);
-					if (LIKELY(IsInside(NeighbourCellPos)))
-					{
-						const auto& NeighbourCell = At(NeighbourCellPos);
-						// Negative filtering can't be performed here,
-						// since the cell's fingerprint includes a sum of internals.
-						if (NeighbourCell.Fingerprint.Matches(Filter.GetFingerprint()))
-						{
-							for (int32 t = 0; t < NeighbourCell.Subjects.Num(); ++t)
-							{
-								const auto OtherBubble = NeighbourCell.Subjects[t];
-								if (LIKELY(OtherBubble.Matches(Filter)))
-								{
-									const auto OtherBubbleSphere =
-										OtherBubble.GetTrait<FBubbleSphere>();
-									const auto OtherLocation =
-										OtherBubble.GetTrait<FLocated>().GetLocation();
-									const auto Delta = Location - OtherLocation;
-									const auto DistanceSqr = Delta.SizeSquared();
-									if (FMath::Square(Radius + OtherBubbleSphere.Radius) > DistanceSqr)
-									{
-										OutOverlappers.Add(OtherBubble);
-									}
-								}
-							}
-						}
-					}
-				}
-			}
-		}
+			OutOverlappers.Add(Subject);
+		});
 		return OutOverlappers.Num();
 	}
 
@@ -524,15 +2498,501 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 	}
 
 	/**
-	 * Get a position within the cage by an index of the cell.
+	 * Get overlapping spheres for a batch of locations at once.
+	 * 
+	 * The queries are sorted by their cells and processed
+	 * concurrently, while all of their results get gathered
+	 * within a single flat buffer. The overlappers of the i-th query
+	 * are stored within the [OutOffsets[i], OutOffsets[i + 1]) range.
+	 * 
+	 * @param Locations The locations to query.
+	 * @param Radii The radii of the queries. Either a radius per
+	 * each of the locations or an empty array for the zero radii.
+	 * @param OutOverlappers The overlapping bubbles of all the queries.
+	 * @param OutOffsets The offsets of the queries within the overlappers.
+	 * @return The total number of the overlappers.
+	 */
+	int32
+	GetOverlappingBatch(TArrayView<const FVector> Locations,
+						TArrayView<const float>   Radii,
+						TArray<FSubjectHandle>&   OutOverlappers,
+						TArray<int32>&            OutOffsets) const;
+
+	/**
+	 * Get overlapping spheres for a batch of locations at once
+	 * narrowing them by a filter.
+	 * 
+	 * The queries are sorted by their cells and processed
+	 * concurrently, while all of their results get gathered
+	 * within a single flat buffer. The overlappers of the i-th query
+	 * are stored within the [OutOffsets[i], OutOffsets[i + 1]) range.
+	 * 
+	 * @param Locations The locations to query.
+	 * @param Radii The radii of the queries. Either a radius per
+	 * each of the locations or an empty array for the zero radii.
+	 * @param Filter The filter to narrow by.
+	 * @param OutOverlappers The overlapping bubbles of all the queries.
+	 * @param OutOffsets The offsets of the queries within the overlappers.
+	 * @return The total number of the overlappers.
+	 */
+	int32
+	GetOverlappingBatch(TArrayView<const FVector> Locations,
+						TArrayView<const float>   Radii,
+						const FFilter&            Filter,
+						TArray<FSubjectHandle>&   OutOverlappers,
+						TArray<int32>&            OutOffsets) const;
+
+	/**
+	 * Get the bubbles overlapping an axis-aligned box.
+	 * 
+	 * The cells fully inside of the box are gathered
+	 * without testing each of their bubbles.
+	 * 
+	 * @param Box The global box to test against.
+	 * @param OutOverlappers The overlapping bubbles.
+	 * @return The number of the overlapping bubbles.
+	 */
+	int32
+	GetOverlappingBox(const FBox&             Box,
+					  TArray<FSubjectHandle>& OutOverlappers) const;
+
+	/**
+	 * Get the bubbles overlapping an axis-aligned box
+	 * and matching a filter.
+	 * 
+	 * @see GetOverlappingBox()
+	 */
+	int32
+	GetOverlappingBox(const FBox&             Box,
+					  const FFilter&          Filter,
+					  TArray<FSubjectHandle>& OutOverlappers) const;
+
+	/**
+	 * Get the bubbles overlapping an oriented box.
+	 * 
+	 * The cells fully inside of the box are gathered
+	 * without testing each of their bubbles.
+	 * 
+	 * @param Center The global center of the box.
+	 * @param Extent The half-size of the box along its own axes.
+	 * @param Rotation The rotation of the box.
+	 * @param OutOverlappers The overlapping bubbles.
+	 * @return The number of the overlapping bubbles.
+	 */
+	int32
+	GetOverlappingOrientedBox(const FVector&          Center,
+							  const FVector&          Extent,
+							  const FQuat&            Rotation,
+							  TArray<FSubjectHandle>& OutOverlappers) const;
+
+	/**
+	 * Get the bubbles overlapping an oriented box
+	 * and matching a filter.
+	 * 
+	 * @see GetOverlappingOrientedBox()
+	 */
+	int32
+	GetOverlappingOrientedBox(const FVector&          Center,
+							  const FVector&          Extent,
+							  const FQuat&            Rotation,
+							  const FFilter&          Filter,
+							  TArray<FSubjectHandle>& OutOverlappers) const;
+
+	/**
+	 * Get the bubbles overlapping a convex volume, like a view frustum.
+	 * 
+	 * The cells fully inside of the volume are gathered
+	 * without testing each of their bubbles.
+	 * 
+	 * @note The bubbles are tested against each of the planes
+	 * individually, so the bubbles near the edges of the volume
+	 * may be reported as overlapping, while actually being outside.
+	 * 
+	 * @param Volume The global convex volume to test against.
+	 * @param OutOverlappers The overlapping bubbles.
+	 * @return The number of the overlapping bubbles.
+	 */
+	int32
+	GetOverlappingConvex(const FConvexVolume&    Volume,
+						 TArray<FSubjectHandle>& OutOverlappers) const;
+
+	/**
+	 * Get the bubbles overlapping a convex volume, like a view frustum,
+	 * and matching a filter.
+	 * 
+	 * @see GetOverlappingConvex()
+	 */
+	int32
+	GetOverlappingConvex(const FConvexVolume&    Volume,
+						 const FFilter&          Filter,
+						 TArray<FSubjectHandle>& OutOverlappers) const;
+
+	/**
+	 * Get the bubbles nearest to a location.
+	 * 
+	 * The cells are searched in the shells expanding from
+	 * the location, stopping as soon as the next shell can't
+	 * contain anything closer than the found bubbles.
+	 * 
+	 * @param Location The location to search around.
+	 * @param K The maximum number of the bubbles to get.
+	 * @param OutNearest The nearest bubbles sorted by
+	 * the distance to their centers.
+	 * @param MaxRadius The maximum distance to the centers of the bubbles.
+	 * @return The number of the bubbles found.
+	 */
+	int32
+	GetNearest(const FVector&          Location,
+			   const int32             K,
+			   TArray<FSubjectHandle>& OutNearest,
+			   const float             MaxRadius = TNumericLimits<float>::Max()) const
+	{
+		OutNearest.SetNumUninitialized(FMath::Max(K, 0));
+		OutNearest.SetNum(DoGetNearest<false>(Location, K, nullptr, AllLayers, MaxRadius, OutNearest.GetData()));
+		return OutNearest.Num();
+	}
+
+	/**
+	 * Get the bubbles nearest to a location and matching a filter.
+	 * 
+	 * The cells are searched in the shells expanding from
+	 * the location, stopping as soon as the next shell can't
+	 * contain anything closer than the found bubbles.
+	 * 
+	 * @param Location The location to search around.
+	 * @param K The maximum number of the bubbles to get.
+	 * @param Filter The filter to narrow by.
+	 * @param MaxRadius The maximum distance to the centers of the bubbles.
+	 * @param OutNearest The nearest bubbles sorted by
+	 * the distance to their centers.
+	 * @return The number of the bubbles found.
+	 */
+	UFUNCTION(BlueprintCallable)
+	int32
+	GetNearest(const FVector&          Location,
+			   const int32             K,
+			   const FFilter&          Filter,
+			   const float             MaxRadius,
+			   TArray<FSubjectHandle>& OutNearest) const
+	{
+		OutNearest.SetNumUninitialized(FMath::Max(K, 0));
+		OutNearest.SetNum(DoGetNearest<true>(Location, K, &Filter, AllLayers, MaxRadius, OutNearest.GetData()));
+		return OutNearest.Num();
+	}
+
+	/**
+	 * Get the bubbles nearest to a location
+	 * and belonging to any of the collision layers.
+	 * 
+	 * @param Location The location to search around.
+	 * @param K The maximum number of the bubbles to get.
+	 * @param LayerMask The collision layers to narrow by.
+	 * @param MaxRadius The maximum distance to the centers of the bubbles.
+	 * @param OutNearest The nearest bubbles sorted by
+	 * the distance to their centers.
+	 * @return The number of the bubbles found.
+	 */
+	UFUNCTION(BlueprintCallable)
+	int32
+	GetNearestInLayers(const FVector&          Location,
+					   const int32             K,
+					   UPARAM(Meta = (Bitmask)) const int32 LayerMask,
+					   const float             MaxRadius,
+					   TArray<FSubjectHandle>& OutNearest) const
+	{
+		OutNearest.SetNumUninitialized(FMath::Max(K, 0));
+		OutNearest.SetNum(DoGetNearest<false>(Location, K, nullptr, (uint32)LayerMask, MaxRadius, OutNearest.GetData()));
+		return OutNearest.Num();
+	}
+
+	/**
+	 * Get the bubbles nearest to each of the locations.
+	 * 
+	 * The queries are processed concurrently. The nearest bubbles
+	 * of the i-th query are stored within the [OutOffsets[i], OutOffsets[i + 1])
+	 * range of the @p OutNearest sorted by their distance.
+	 * 
+	 * @param Locations The locations to search around.
+	 * @param K The maximum number of the bubbles to get per each of the locations.
+	 * @param OutNearest The nearest bubbles of all the queries.
+	 * @param OutOffsets The offsets of the queries within the nearest bubbles.
+	 * @param MaxRadius The maximum distance to the centers of the bubbles.
+	 * @return The total number of the bubbles found.
+	 */
+	int32
+	GetNearestBatch(TArrayView<const FVector> Locations,
+					const int32               K,
+					TArray<FSubjectHandle>&   OutNearest,
+					TArray<int32>&            OutOffsets,
+					const float               MaxRadius = TNumericLimits<float>::Max()) const
+	{
+		return DoGetNearestBatch<false>(Locations, K, nullptr, AllLayers, MaxRadius, OutNearest, OutOffsets);
+	}
+
+	/**
+	 * Get the bubbles nearest to each of the locations
+	 * and matching a filter.
+	 * 
+	 * @see GetNearestBatch()
+	 */
+	int32
+	GetNearestBatch(TArrayView<const FVector> Locations,
+					const int32               K,
+					const FFilter&            Filter,
+					const float               MaxRadius,
+					TArray<FSubjectHandle>&   OutNearest,
+					TArray<int32>&            OutOffsets) const
+	{
+		return DoGetNearestBatch<true>(Locations, K, &Filter, AllLayers, MaxRadius, OutNearest, OutOffsets);
+	}
+
+	/**
+	 * Cast a sphere through the cage, getting the closest hit.
+	 * 
+	 * Only the cells along the cast are visited.
+	 * 
+	 * @param Start The start of the cast.
+	 * @param End The end of the cast.
+	 * @param Radius The radius of the sphere.
+	 * @param OutHit The closest hit.
+	 * @return Was anything hit.
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool
+	SphereCast(const FVector&  Start,
+			   const FVector&  End,
+			   const float     Radius,
+			   FBubbleCageHit& OutHit) const
+	{
+		return DoSphereCast<false>(Start, End, Radius, nullptr, AllLayers, &OutHit, nullptr);
+	}
+
+	/**
+	 * Cast a sphere through the cage, getting the closest
+	 * hit matching a filter.
+	 * 
+	 * Only the cells along the cast are visited.
+	 */
+	bool
+	SphereCast(const FVector&  Start,
+			   const FVector&  End,
+			   const float     Radius,
+			   const FFilter&  Filter,
+			   FBubbleCageHit& OutHit) const
+	{
+		return DoSphereCast<true>(Start, End, Radius, &Filter, AllLayers, &OutHit, nullptr);
+	}
+
+	/**
+	 * Cast a sphere through the cage, getting all of the hits.
+	 * 
+	 * @param Start The start of the cast.
+	 * @param End The end of the cast.
+	 * @param Radius The radius of the sphere.
+	 * @param OutHits All the hits sorted by their distance.
+	 * @return The number of the hits.
+	 */
+	UFUNCTION(BlueprintCallable)
+	int32
+	SphereCastAll(const FVector&          Start,
+				  const FVector&          End,
+				  const float             Radius,
+				  TArray<FBubbleCageHit>& OutHits) const
+	{
+		DoSphereCast<false>(Start, End, Radius, nullptr, AllLayers, nullptr, &OutHits);
+		return OutHits.Num();
+	}
+
+	/**
+	 * Cast a sphere through the cage, getting all of
+	 * the hits matching a filter.
+	 */
+	int32
+	SphereCastAll(const FVector&          Start,
+				  const FVector&          End,
+				  const float             Radius,
+				  const FFilter&          Filter,
+				  TArray<FBubbleCageHit>& OutHits) const
+	{
+		DoSphereCast<true>(Start, End, Radius, &Filter, AllLayers, nullptr, &OutHits);
+		return OutHits.Num();
+	}
+
+	/**
+	 * Cast a sphere through the cage, getting the closest
+	 * hit belonging to any of the collision layers.
+	 * 
+	 * @param Start The start of the cast.
+	 * @param End The end of the cast.
+	 * @param Radius The radius of the sphere.
+	 * @param LayerMask The collision layers to narrow by.
+	 * @param OutHit The closest hit.
+	 * @return Was anything hit.
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool
+	SphereCastInLayers(const FVector&  Start,
+					   const FVector&  End,
+					   const float     Radius,
+					   UPARAM(Meta = (Bitmask)) const int32 LayerMask,
+					   FBubbleCageHit& OutHit) const
+	{
+		return DoSphereCast<false>(Start, End, Radius, nullptr, (uint32)LayerMask, &OutHit, nullptr);
+	}
+
+	/**
+	 * Cast a segment through the cage, getting the closest hit.
+	 */
+	bool
+	SegmentCast(const FVector&  Start,
+				const FVector&  End,
+				FBubbleCageHit& OutHit) const
+	{
+		return SphereCast(Start, End, 0.0f, OutHit);
+	}
+
+	/**
+	 * Cast a segment through the cage, getting the closest
+	 * hit matching a filter.
+	 */
+	bool
+	SegmentCast(const FVector&  Start,
+				const FVector&  End,
+				const FFilter&  Filter,
+				FBubbleCageHit& OutHit) const
+	{
+		return SphereCast(Start, End, 0.0f, Filter, OutHit);
+	}
+
+	/**
+	 * Cast a segment through the cage, getting all of the hits.
+	 */
+	int32
+	SegmentCastAll(const FVector&          Start,
+				   const FVector&          End,
+				   TArray<FBubbleCageHit>& OutHits) const
+	{
+		return SphereCastAll(Start, End, 0.0f, OutHits);
+	}
+
+	/**
+	 * Cast a segment through the cage, getting all of
+	 * the hits matching a filter.
+	 */
+	int32
+	SegmentCastAll(const FVector&          Start,
+				   const FVector&          End,
+				   const FFilter&          Filter,
+				   TArray<FBubbleCageHit>& OutHits) const
+	{
+		return SphereCastAll(Start, End, 0.0f, Filter, OutHits);
+	}
+
+	/**
+	 * Get the end of a ray clipped by the bounds of the cage.
+	 */
+	FORCEINLINE FVector
+	GetRayEnd(const FVector& Origin, const FVector& Direction) const
+	{
+		const auto Extent = Bounds.GetSize().Size() + FVector::Dist(Origin, Bounds.GetCenter());
+		return Origin + Direction.GetSafeNormal() * Extent;
+	}
+
+	/**
+	 * Cast a ray through the cage, getting the closest hit.
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool
+	RayCast(const FVector&  Origin,
+			const FVector&  Direction,
+			FBubbleCageHit& OutHit) const
+	{
+		return SegmentCast(Origin, GetRayEnd(Origin, Direction), OutHit);
+	}
+
+	/**
+	 * Cast a ray through the cage, getting the closest
+	 * hit matching a filter.
+	 */
+	bool
+	RayCast(const FVector&  Origin,
+			const FVector&  Direction,
+			const FFilter&  Filter,
+			FBubbleCageHit& OutHit) const
+	{
+		return SegmentCast(Origin, GetRayEnd(Origin, Direction), Filter, OutHit);
+	}
+
+	/**
+	 * Cast a ray through the cage, getting all of the hits.
+	 */
+	int32
+	RayCastAll(const FVector&          Origin,
+			   const FVector&          Direction,
+			   TArray<FBubbleCageHit>& OutHits) const
+	{
+		return SegmentCastAll(Origin, GetRayEnd(Origin, Direction), OutHits);
+	}
+
+	/**
+	 * Cast a ray through the cage, getting all of
+	 * the hits matching a filter.
+	 */
+	int32
+	RayCastAll(const FVector&          Origin,
+			   const FVector&          Direction,
+			   const FFilter&          Filter,
+			   TArray<FBubbleCageHit>& OutHits) const
+	{
+		return SegmentCastAll(Origin, GetRayEnd(Origin, Direction), Filter, OutHits);
+	}
+
+	/**
+	 * Get a position within the cage by an index of the cell.
+	 */
+	FORCEINLINE FIntVector
+	GetCellPointByIndex(int32 Index) const
+	{
+		return GetLayoutPoint(Size, Index);
+	}
+
+	/**
+	 * Get a position within the level by an index of the cell,
+	 * respecting the sparse cells.
+	 * 
+	 * @param CellIndex The index of the cell.
+	 * @param OutLevel The level of the cell.
+	 * @return The position of the cell within its level.
+	 */
+	FORCEINLINE FIntVector
+	GetCellPoint(const int32 CellIndex, int32& OutLevel) const
+	{
+		if (bSparseCells)
+		{
+			static constexpr uint64 AxisMask = (1ull << SparseKeyAxisBits) - 1;
+			const auto Key = SparseKeys[CellIndex];
+			OutLevel = (int32)(Key >> (3 * SparseKeyAxisBits));
+			return FIntVector((int32)(Key & AxisMask),
+							  (int32)((Key >> SparseKeyAxisBits) & AxisMask),
+							  (int32)((Key >> (2 * SparseKeyAxisBits)) & AxisMask));
+		}
+		OutLevel = 0;
+		while (CellIndex >= LevelBases[OutLevel + 1])
+		{
+			++OutLevel;
+		}
+		return GetLayoutPoint(GetLevelSize(OutLevel), CellIndex - LevelBases[OutLevel]);
+	}
+
+	/**
+	 * Get a position within the level by an index of the cell,
+	 * respecting the sparse cells.
 	 */
 	FORCEINLINE FIntVector
-	GetCellPointByIndex(int32 Index) const
+	GetCellPoint(const int32 CellIndex) const
 	{
-		int32 z = Index / (Size.X * Size.Y);
-		int32 LayerPadding = Index - (z * Size.X * Size.Y);
-
-		return FIntVector(LayerPadding / Size.X, LayerPadding % Size.X , z);
+		int32 Level;
+		return GetCellPoint(CellIndex, Level);
 	}
 
 	/* Get the index of the cage cell. */
@@ -576,7 +3036,164 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 	FORCEINLINE bool
 	IsInside(const FVector& WorldPoint) const
 	{
-		return IsInside(WorldToCage(WorldPoint));
+		auto CellPoint = WorldToCage(WorldPoint);
+		if (bPlanar)
+		{
+			// The height is passed through.
+			CellPoint.Z = 0;
+		}
+		return IsInside(CellPoint);
+	}
+
+	/**
+	 * Bring a location that has left the cage back
+	 * according to the bounds policy.
+	 * 
+	 * @param Location The global location to confine.
+	 * @return Should the bubble be kept within the cage.
+	 */
+	FORCEINLINE bool
+	ConfineToBounds(FVector& Location) const
+	{
+		const auto Extent = Bounds.GetSize();
+		const auto AxesNum = bPlanar ? 2 : 3;
+		auto LocalLocation = WorldToBounded(Location);
+		switch (BoundsPolicy)
+		{
+			case EBubbleCageBoundsPolicy::Clamp:
+				break;
+			case EBubbleCageBoundsPolicy::Reflect:
+				for (int32 Axis = 0; Axis < AxesNum; ++Axis)
+				{
+					if (LocalLocation[Axis] < 0)
+					{
+						LocalLocation[Axis] = -LocalLocation[Axis];
+					}
+					else if (LocalLocation[Axis] >= Extent[Axis])
+					{
+						LocalLocation[Axis] = 2 * Extent[Axis] - LocalLocation[Axis];
+					}
+				}
+				break;
+			case EBubbleCageBoundsPolicy::Wrap:
+				for (int32 Axis = 0; Axis < AxesNum; ++Axis)
+				{
+					LocalLocation[Axis] = FMath::Fmod(LocalLocation[Axis], Extent[Axis]);
+					if (LocalLocation[Axis] < 0)
+					{
+						LocalLocation[Axis] += Extent[Axis];
+					}
+				}
+				break;
+			case EBubbleCageBoundsPolicy::Overflow:
+				return true;
+			default:
+				return false;
+		}
+		// Keep strictly within the last cells, since
+		// the reflection or the rounding may still overshoot...
+		for (int32 Axis = 0; Axis < AxesNum; ++Axis)
+		{
+			LocalLocation[Axis] = FMath::Clamp(LocalLocation[Axis], 0.0, Extent[Axis] - KINDA_SMALL_NUMBER);
+		}
+		Location = Bounds.Min + LocalLocation;
+		return true;
+	}
+
+	/**
+	 * Clamp a cage point to the cells of a level.
+	 * 
+	 * Used to bin the bubbles overflowing the cage.
+	 */
+	FORCEINLINE FIntVector
+	ClampToLevel(const FIntVector& CellPoint, const int32 Level) const
+	{
+		const auto LevelSize = GetLevelSize(Level);
+		return FIntVector(FMath::Clamp(CellPoint.X, 0, LevelSize.X - 1),
+						  FMath::Clamp(CellPoint.Y, 0, LevelSize.Y - 1),
+						  FMath::Clamp(CellPoint.Z, 0, LevelSize.Z - 1));
+	}
+
+	/**
+	 * Get the cage-local center to search the cells around.
+	 * 
+	 * The overflowing bubbles are binned within the border
+	 * cells, so the searches from outside of the cage start
+	 * at the nearest point of the bounds. The clamping never
+	 * increases the distances, so nothing is missed this way.
+	 */
+	FORCEINLINE FVector
+	GetSearchCenter(const FVector& LocalLocation) const
+	{
+		if (LIKELY(BoundsPolicy != EBubbleCageBoundsPolicy::Overflow))
+		{
+			return LocalLocation;
+		}
+		const auto Extent = Bounds.GetSize();
+		return FVector(FMath::Clamp(LocalLocation.X, 0.0, Extent.X),
+					   FMath::Clamp(LocalLocation.Y, 0.0, Extent.Y),
+					   FMath::Clamp(LocalLocation.Z, 0.0, Extent.Z));
+	}
+
+	/**
+	 * Iterate the periodic images of a location
+	 * within the wrapping cage.
+	 * 
+	 * The location itself is always iterated first.
+	 * The images shifted by the extent of the cage are iterated
+	 * only along the axes where the range crosses the bounds.
+	 * 
+	 * @param Location The global location to get the images of.
+	 * @param Range The range of the search around the location.
+	 * @param Functor The functor to call with each of the global images.
+	 * May return @c false to stop the iterating.
+	 * @return Was the iterating completed without an early-out.
+	 */
+	template < typename FunctorT >
+	FORCEINLINE bool
+	ForEachImage(const FVector& Location,
+				 const float    Range,
+				 FunctorT&&     Functor) const
+	{
+		if (LIKELY(BoundsPolicy != EBubbleCageBoundsPolicy::Wrap))
+		{
+			return FBubbleCageKernel::Visit(Functor, Location);
+		}
+		const auto Extent = Bounds.GetSize();
+		const auto LocalLocation = WorldToBounded(Location);
+		double Shifts[3][3];
+		int32 ShiftsNum[3];
+		for (int32 Axis = 0; Axis < 3; ++Axis)
+		{
+			ShiftsNum[Axis] = 0;
+			Shifts[Axis][ShiftsNum[Axis]++] = 0;
+			if (bPlanar && (Axis == 2)) continue;
+			if (LocalLocation[Axis] - Range < 0)
+			{
+				Shifts[Axis][ShiftsNum[Axis]++] = Extent[Axis];
+			}
+			if (LocalLocation[Axis] + Range >= Extent[Axis])
+			{
+				Shifts[Axis][ShiftsNum[Axis]++] = -Extent[Axis];
+			}
+		}
+		for (int32 i = 0; i < ShiftsNum[0]; ++i)
+		{
+			for (int32 j = 0; j < ShiftsNum[1]; ++j)
+			{
+				for (int32 k = 0; k < ShiftsNum[2]; ++k)
+				{
+					const FVector Image(Location.X + Shifts[0][i],
+										Location.Y + Shifts[1][j],
+										Location.Z + Shifts[2][k]);
+					if (!FBubbleCageKernel::Visit(Functor, Image))
+					{
+						return false;
+					}
+				}
+			}
+		}
+		return true;
 	}
 
 	/* Get subjects in a specific cage cell by position in the cage. */
@@ -632,66 +3249,80 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 	{
 		QUICK_SCOPE_CYCLE_COUNTER(STAT_BubbleCage_Update);
 
+		WaitForEvaluation();
+
+		if (IsPacked())
+		{
+			UpdatePacked();
+			return;
+		}
+
+		if ((UpdateMode == EBubbleCageUpdateMode::Incremental) && bCellsFilled)
+		{
+			UpdateIncrementally();
+			return;
+		}
+
 		const auto Mechanism = GetMechanism();
 
 		// Clear-up the cage...
 		int32 CellIndex;
 		while (OccupiedCells.Dequeue(CellIndex))
 		{
-			auto& Cell = Cells[CellIndex];
-			Cell.Subjects.Empty();
-			Cell.Fingerprint.Reset();
+			Cells[CellIndex].Reset();
 		}
+		CellOccupantsNum.store(0, std::memory_order_relaxed);
 		
 		// Use atomic for a thread safety:
 		std::atomic<float> AtomicLargestRadius{0};
+		std::atomic<float> AtomicLowestHeight{TNumericLimits<float>::Max()};
+		std::atomic<float> AtomicHighestHeight{TNumericLimits<float>::Lowest()};
 
 		// Occupy the cage cells...
 		static const auto Filter = FFilter::Make<FLocated, FBubbleSphere>();
 		Mechanism->EnchainSolid(Filter)->OperateConcurrently(
 		[&](FSolidSubjectHandle  Subject,
-			const FLocated&      Located,
+			FLocated&            Located,
 			FBubbleSphere&       BubbleSphere)
 		{
-			const auto Location = Located.Location;
-			if (UNLIKELY(!IsInside(Location)))
+			if (UNLIKELY(!IsInside(Located.Location) && !ConfineToBounds(Located.Location)))
 			{
+				BubbleSphere.CellIndex = INDEX_NONE;
 				Subject.DespawnDeferred();
 				return;
 			}
-			{
-				// Solve the largest radius...
-				auto Largest = AtomicLargestRadius.load(std::memory_order_relaxed);
-				if (Largest < BubbleSphere.Radius)
-				{
-					while (!AtomicLargestRadius.compare_exchange_weak(Largest, BubbleSphere.Radius, std::memory_order_relaxed))
-					{
-						if (Largest >= BubbleSphere.Radius)
-						{
-							break;
-						}
-					}
-				}
-			}
+			const auto Location = Located.Location;
+			// Solve the largest radius...
+			AtomicMax(AtomicLargestRadius, BubbleSphere.Radius);
+			GatherHeight(AtomicLowestHeight, AtomicHighestHeight, Location);
 
 			BubbleSphere.CellIndex = GetIndexAt(Location);
+			BubbleSphere.CageLocation = FVector3f(WorldToBounded(Location));
 			{
 				auto& Cell = Cells[BubbleSphere.CellIndex];
 				Cell.Lock();
-				const auto Index = Cell.Subjects.Add((FSubjectHandle)Subject);
+				const auto Index = Cell.Add((FSubjectHandle)Subject, MakeCellOccupant(BubbleSphere));
+				BubbleSphere.CellSlot = Index;
 				Cell.Fingerprint.Add(Subject.GetFingerprint());
+				Cell.Layers |= BubbleSphere.CollisionLayers;
 				Cell.Unlock();
 				if (Index == 0)
 				{
 					OccupiedCells.Enqueue(BubbleSphere.CellIndex);
 				}
-			}			
+			}
+			CellOccupantsNum.fetch_add(1, std::memory_order_relaxed);
 		}, ThreadsCount);
 
 		LargestRadius = AtomicLargestRadius.load(std::memory_order_relaxed);
+		LevelLargestRadii[0] = LargestRadius;
+		LowestHeight = AtomicLowestHeight.load(std::memory_order_relaxed);
+		HighestHeight = AtomicHighestHeight.load(std::memory_order_relaxed);
+		bCellsFilled = true;
+		UpdatesSinceCompaction = 0;
 	}
 
-	template < bool bUseTrait >
+	template < bool bUseTrait, bool bFlat >
 	void
 	DoDecouple()
 	{
@@ -700,96 +3331,216 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 		const auto Mechanism = GetMechanism();
 
 		static const auto Filter = FFilter::Make<FLocated, FBubbleSphere>();
+		if (bDeterministic && !IsPacked())
+		{
+			// The unpacked cells are filled and moved
+			// among concurrently, so order them right here...
+			SortCells();
+		}
+
+		const auto bContacts = IsGatheringContacts();
+		if (bContacts)
+		{
+			BeginContacts();
+		}
+
 		// Detect collisions...
+		if (IsSharded() || IsPairwise())
 		{
-			QUICK_SCOPE_CYCLE_COUNTER(STAT_BubbleCage_DetectCollisions);
+			QUICK_SCOPE_CYCLE_COUNTER(STAT_BubbleCage_DetectPairs);
 			CoupledSubjects.Empty();
+			if (IsSharded())
+			{
+				DetectSharded();
+			}
+			else
+			{
+				DetectPairwise();
+			}
+			const auto Decouples = PairwiseDecouples[0].GetData();
 			Mechanism->EnchainSolid(Filter)->OperateConcurrently(
+			[&](FSolidSubjectHandle Bubble,
+				FLocated&           Located,
+				FBubbleSphere&      BubbleSphere)
+			{
+				const auto PackedIndex = BubbleSphere.PackedIndex;
+				if (UNLIKELY(!PackedSubjects.IsValidIndex(PackedIndex) ||
+							 (PackedSubjects[PackedIndex] != (FSubjectHandle)Bubble))) return;
+				const auto& Decouple = Decouples[PackedIndex];
+				if (Decouple.W == 0) return;
+				BubbleSphere.AccumulatedDecouple = FVector(Decouple.X, Decouple.Y, Decouple.Z);
+				BubbleSphere.AccumulatedDecoupleCount = (int32)Decouple.W;
+				MarkCoupled<bUseTrait>(Bubble, Located, BubbleSphere);
+			}, ThreadsCount);
+		}
+		else
+		{
+			QUICK_SCOPE_CYCLE_COUNTER(STAT_BubbleCage_DetectCollisions);
+			CoupledSubjects.Empty();
+			// Use atomic for a thread safety:
+			std::atomic<float> AtomicMaxPenetration{0};
+			const auto bSleeping = IsSleeping();
+			const auto DetectCollisions =
 			[&](FSolidSubjectHandle Bubble,
 				FLocated&           Located,
 				FBubbleSphere&      BubbleSphere)
 			{
 				if (UNLIKELY(BubbleSphere.DecoupleProportion <= 0.0f)) return;
-				const auto Location = Located.Location;
-				const auto Range = FVector(BubbleSphere.Radius + LargestRadius);
-				const auto CagePosMin = WorldToCage(Location - Range);
-				const auto CagePosMax = WorldToCage(Location + Range);
-				for (auto i = CagePosMin.X; i <= CagePosMax.X; ++i)
+				if (bSleeping)
+				{
+					if (bFirstPass)
+					{
+						TrackRest(BubbleSphere, Located.Location);
+					}
+					if (IsAsleep(BubbleSphere)) return;
+				}
+				if (bSweptDecoupling && bFirstPass && Sweep((FSubjectHandle)Bubble, Located, BubbleSphere))
+				{
+					// The impact takes over the overlaps at the end of the motion...
+					MarkCoupled<bUseTrait>(Bubble, Located, BubbleSphere);
+					return;
+				}
+				// Only the bubbles that have just moved may wake the others...
+				const auto bWaking = bSleeping && bFirstPass && (BubbleSphere.RestingCount == 0);
+				const auto Layers = (uint32)BubbleSphere.CollisionLayers;
+				const auto Mask = (uint32)BubbleSphere.CollisionMask;
+				float Penetration = 0.0f;
+				ForEachImage(Located.Location, BubbleSphere.Radius + LargestRadius + DisplacementSlack, [&](const FVector& Location)
 				{
-					for (auto j = CagePosMin.Y; j <= CagePosMax.Y; ++j)
+					const auto LocalLocation = FVector3f(WorldToBounded(Location));
+					DoForEachCellNear<bFlat>(Location, BubbleSphere.Radius, [&](const int32 CellIndex)
 					{
-						for (auto k = CagePosMin.Z; k <= CagePosMax.Z; ++k)
+						if (!(GetCellLayers(CellIndex) & Mask)) return;
+						ForEachOverlappingIn<bFlat>(CellIndex, LocalLocation, BubbleSphere.Radius,
+						[&](const FOccupant& Occupant)
 						{
-							const auto NeighbourCellPos = FIntVector(i, j, k);
-							if (LIKELY(IsInside(NeighbourCellPos)))
+							const auto OtherBubble = Occupant.Subject;
+							if (UNLIKELY(!OtherBubble || (OtherBubble == (FSubjectHandle)Bubble))) return;
+							if (!(Occupant.Layers & Mask) || !(Occupant.Mask & Layers)) return;
+							auto Delta = LocalLocation - Occupant.Location;
+							if (bFlat) // Compile-time branch.
+							{
+								Delta.Z = 0;
+							}
+							const auto Distance = FMath::Sqrt(Delta.SizeSquared());
+							const float DistanceDelta = BubbleSphere.Radius + Occupant.Radius - Distance;
+							Penetration = FMath::Max(Penetration, DistanceDelta);
+							// The pair is registered by a single of its bubbles,
+							// while the static and the sleeping ones do not detect anything...
+							if (bContacts && ((Bubble.GetId() < OtherBubble.GetId()) || (Occupant.DecoupleProportion <= 0.0f) || bWaking ||
+											  (bSleeping && IsAsleep(OtherBubble))))
+							{
+								AddContact((FSubjectHandle)Bubble, OtherBubble);
+							}
+							if (bWaking && (Occupant.DecoupleProportion > 0.0f))
+							{
+								WokenSubjects.Enqueue(OtherBubble);
+							}
+							const float Strength = BubbleSphere.DecoupleProportion /
+											(BubbleSphere.DecoupleProportion + Occupant.DecoupleProportion);
+							// We're hitting a neighbor.
+							if (UNLIKELY(Distance <= SMALL_NUMBER))
 							{
-								const auto& NeighbourCell = At(NeighbourCellPos);
-								for (int32 t = 0; t < NeighbourCell.Subjects.Num(); ++t)
+								// The distance is too small to get the direction.
+								// Use the ids to get the direction.
+								if (Bubble.GetId() > OtherBubble.GetId())
+								{
+									BubbleSphere.AccumulatedDecouple +=
+										FVector::LeftVector * DistanceDelta *
+										Strength;
+								}
+								else
 								{
-									const auto OtherBubble = (FSolidSubjectHandle)NeighbourCell.Subjects[t];
-									if (LIKELY(OtherBubble && (OtherBubble != Bubble)))
-									{
-										const auto& OtherBubbleSphere =
-											OtherBubble.GetTraitRef<FBubbleSphere>();
-										const auto OtherLocation =
-											OtherBubble.GetTraitRef<FLocated>().GetLocation();
-										const auto Delta = Location - OtherLocation;
-										auto Distance = Delta.SizeSquared();
-										const auto NeededDistance = BubbleSphere.Radius + OtherBubbleSphere.Radius;
-										if (Distance < FMath::Square(NeededDistance))
-										{
-											Distance = FMath::Sqrt(Distance);
-											const float DistanceDelta = NeededDistance - Distance;
-											const float Strength = BubbleSphere.DecoupleProportion /
-															(BubbleSphere.DecoupleProportion + OtherBubbleSphere.DecoupleProportion);
-											// We're hitting a neighbor.
-											if (UNLIKELY(Distance <= SMALL_NUMBER))
-											{
-												// The distance is too small to get the direction.
-												// Use the ids to get the direction.
-												if (Bubble.GetId() > OtherBubble.GetId())
-												{
-													BubbleSphere.AccumulatedDecouple +=
-														FVector::LeftVector * DistanceDelta *
-														Strength;
-												}
-												else
-												{
-													BubbleSphere.AccumulatedDecouple +=
-														FVector::RightVector * DistanceDelta *
-														Strength;
-												}
-											}
-											else
-											{
-												BubbleSphere.AccumulatedDecouple +=
-													(Delta / Distance) * DistanceDelta *
-													Strength;
-											}
-											if (BubbleSphere.AccumulatedDecoupleCount++ == 0)
-											{
-												if (bUseTrait) // Compile-time branch
-												{
-													Bubble.SetTraitDeferred(FCoupling{});
-												}
-												else
-												{
-													CoupledSubjects.Enqueue(FCouplingEntry((FSubjectHandle)Bubble, &Located, &BubbleSphere));
-												}
-											}
-										}
-									}
+									BubbleSphere.AccumulatedDecouple +=
+										FVector::RightVector * DistanceDelta *
+										Strength;
 								}
 							}
+							else
+							{
+								BubbleSphere.AccumulatedDecouple +=
+									FVector(Delta / Distance) * DistanceDelta *
+									Strength;
+							}
+							if (BubbleSphere.AccumulatedDecoupleCount++ == 0)
+							{
+								MarkCoupled<bUseTrait>(Bubble, Located, BubbleSphere);
+							}
+						});
+					});
+				});
+				if (Penetration > 0.0f)
+				{
+					AtomicMax(AtomicMaxPenetration, Penetration);
+				}
+			};
+			// The coupling trait is only added by the mechanism's own
+			// operating, so the traversal of the cells is left for the queue...
+			if (!bUseTrait && bMortonCells && !bSparseCells && bCellsFilled)
+			{
+				// Traverse the subjects in the order of the cells,
+				// so each of the workers gets a spatially coherent chunk.
+				// The occupied cells are sorted within the Morton layout...
+				if (!IsPacked())
+				{
+					DequeueOccupiedCells(MortonCells);
+				}
+				const auto ItemsNum = IsPacked() ? PackedSubjects.Num() : MortonCells.Num();
+				const auto ChunksNum = FMath::Max(1, FMath::Min(ThreadsCount, ItemsNum));
+				ParallelFor(ChunksNum, [&](const int32 Chunk)
+				{
+					const auto Begin = (int32)(((int64)ItemsNum * Chunk) / ChunksNum);
+					const auto End = (int32)(((int64)ItemsNum * (Chunk + 1)) / ChunksNum);
+					const auto DetectCollisionsOf = [&](const FSubjectHandle& Subject)
+					{
+						auto Bubble = (FSolidSubjectHandle)Subject;
+						if (UNLIKELY(!Bubble || !Bubble.Matches(Filter))) return;
+						DetectCollisions(Bubble, Bubble.GetTraitRef<FLocated>(), Bubble.GetTraitRef<FBubbleSphere>());
+					};
+					for (int32 i = Begin; i < End; ++i)
+					{
+						if (IsPacked())
+						{
+							DetectCollisionsOf(PackedSubjects[i]);
+							continue;
+						}
+						const auto& Subjects = Cells[MortonCells[i]].Subjects;
+						for (int32 t = 0; t < Subjects.Num(); ++t)
+						{
+							DetectCollisionsOf(Subjects[t]);
 						}
 					}
+				});
+				if (!IsPacked())
+				{
+					for (const auto CellIndex : MortonCells)
+					{
+						OccupiedCells.Enqueue(CellIndex);
+					}
 				}
-			}, ThreadsCount);
+			}
+			else
+			{
+				Mechanism->EnchainSolid(Filter)->OperateConcurrently(DetectCollisions, ThreadsCount);
+			}
+			MaxPenetration = AtomicMaxPenetration.load(std::memory_order_relaxed);
+		}
+		if (bContacts)
+		{
+			EndContacts();
+		}
+		if (IsSleeping())
+		{
+			// Wake only after the contacts of the sleeping
+			// bubbles have been carried on...
+			WakeSubjects();
 		}
 
 		// Decouple...
 		{
 			QUICK_SCOPE_CYCLE_COUNTER(STAT_BubbleCage_DecoupleThroughLocations);
+			// Use atomic for a thread safety:
+			std::atomic<float> AtomicLargestDisplacement{0};
 			if (bUseTrait) // Compile-time branch.
 			{
 				Mechanism->OperateConcurrently(
@@ -798,83 +3549,123 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 					FBubbleSphere&      BubbleSphere,
 					const FCoupling&)
 				{
-					Located.Location += BubbleSphere.AccumulatedDecouple /
-										BubbleSphere.AccumulatedDecoupleCount;
-					BubbleSphere.AccumulatedDecouple = FVector::ZeroVector;
-					BubbleSphere.AccumulatedDecoupleCount = 0;
 					Subject.RemoveTraitDeferred<FCoupling>();
-
-					if (UNLIKELY(!IsInside(Located.Location)))
-					{
-						Subject.DespawnDeferred();
-						return;
-					}
-
-					const auto NewCellIndex = GetIndexAt(Located.Location);
-					if (BubbleSphere.CellIndex != NewCellIndex)
-					{
-						auto& FormerCell = Cells[BubbleSphere.CellIndex];
-						FormerCell.Lock();
-						FormerCell.Subjects.Remove((FSubjectHandle)Subject);
-						FormerCell.Unlock();
-						auto& NewCell = Cells[NewCellIndex];
-						NewCell.Lock();
-						const auto Index = NewCell.Subjects.Add((FSubjectHandle)Subject);
-						NewCell.Fingerprint.Add(Subject.GetFingerprint());
-						NewCell.Unlock();
-						BubbleSphere.CellIndex = NewCellIndex;
-						if (Index == 0)
-						{
-							OccupiedCells.Enqueue(NewCellIndex);
-						}
-					}
+					ApplyDecouple((FSubjectHandle)Subject, Located, BubbleSphere, AtomicLargestDisplacement);
 				}, ThreadsCount);
 			}
 			else
 			{
+				// Drain the queue, so the subjects can be decoupled concurrently.
+				// The cells are transferred under their locks here...
+				CouplingEntries.Reset();
 				FCouplingEntry Coupling;
 				while (CoupledSubjects.Dequeue(Coupling))
 				{
-					if (Coupling.Subject && (Coupling.BubbleSphere->AccumulatedDecoupleCount > 0)) // Can already be handled and even despawned.
+					CouplingEntries.Add(Coupling);
+				}
+				const auto EntriesNum = CouplingEntries.Num();
+				const auto ChunksNum = FMath::Max(1, FMath::Min(ThreadsCount, EntriesNum));
+				ParallelFor(ChunksNum, [&](const int32 Chunk)
+				{
+					const auto Begin = (int32)(((int64)EntriesNum * Chunk) / ChunksNum);
+					const auto End = (int32)(((int64)EntriesNum * (Chunk + 1)) / ChunksNum);
+					for (int32 i = Begin; i < End; ++i)
 					{
-						auto& Located      = *Coupling.Located;
-						auto& BubbleSphere = *Coupling.BubbleSphere;
-						check(BubbleSphere.AccumulatedDecoupleCount > 0);
-						Located.Location += BubbleSphere.AccumulatedDecouple /
-											BubbleSphere.AccumulatedDecoupleCount;
-						BubbleSphere.AccumulatedDecouple = FVector::ZeroVector;
-						BubbleSphere.AccumulatedDecoupleCount = 0;
-
-						if (UNLIKELY(!IsInside(Located.Location)))
-						{
-							// We can't despawn normally here, since it will
-							// screw up the direct trait references in the queue.
-							Coupling.Subject.DespawnDeferred();
-							continue;
-						}
-
-						const auto NewCellIndex = GetIndexAt(Located.Location);
-						if (BubbleSphere.CellIndex != NewCellIndex)
+						const auto& Entry = CouplingEntries[i];
+						if (Entry.Subject && (Entry.BubbleSphere->AccumulatedDecoupleCount > 0)) // Can already be handled and even despawned.
 						{
-							// Not using locks here, cause we're in a single-threaded mode...
-							auto& FormerCell = Cells[BubbleSphere.CellIndex];
-							FormerCell.Subjects.Remove(Coupling.Subject);
-							auto& NewCell = Cells[NewCellIndex];
-							const auto Index = NewCell.Subjects.Add(Coupling.Subject);
-							NewCell.Fingerprint.Add(Coupling.Subject.GetFingerprint());
-							BubbleSphere.CellIndex = NewCellIndex;
-							if (Index == 0)
-							{
-								OccupiedCells.Enqueue(NewCellIndex);
-							}
+							ApplyDecouple(Entry.Subject, *Entry.Located, *Entry.BubbleSphere, AtomicLargestDisplacement);
 						}
 					}
-				}
-				Mechanism->ApplyDeferreds();
+				});
+				ApplyDeferreds();
 			}
+			DisplacementSlack += AtomicLargestDisplacement.load(std::memory_order_relaxed);
 		}
 	}
 
+	/**
+	 * Apply the deferred changes of the bubbles.
+	 * 
+	 * Postponed until WaitForEvaluation() while
+	 * being evaluated asynchronously, since the changes
+	 * may only be applied on the game thread.
+	 */
+	void
+	ApplyDeferreds();
+
+	/**
+	 * Get the deepest penetration among the bubbles
+	 * detected during the latest decoupling.
+	 */
+	FORCEINLINE float
+	GetMaxPenetration() const
+	{
+		return MaxPenetration;
+	}
+
+	/**
+	 * Get all of the bubbles currently touching each other.
+	 * 
+	 * Only available with #bTrackContacts enabled.
+	 */
+	FORCEINLINE const TArray<FBubbleCageContact>&
+	GetContacts() const
+	{
+		return Contacts;
+	}
+
+	/**
+	 * Get the contacts that have begun
+	 * during the latest evaluation.
+	 */
+	FORCEINLINE const TArray<FBubbleCageContact>&
+	GetBeganContacts() const
+	{
+		return BeganContacts;
+	}
+
+	/**
+	 * Get the contacts that were present
+	 * during the previous evaluation and are still present.
+	 */
+	FORCEINLINE const TArray<FBubbleCageContact>&
+	GetPersistingContacts() const
+	{
+		return PersistingContacts;
+	}
+
+	/**
+	 * Get the contacts that have ended
+	 * during the latest evaluation.
+	 * 
+	 * The bubbles of these may already be despawned.
+	 */
+	FORCEINLINE const TArray<FBubbleCageContact>&
+	GetEndedContacts() const
+	{
+		return EndedContacts;
+	}
+
+	/**
+	 * Get the changes of the contacts
+	 * during the latest evaluation.
+	 * 
+	 * @param OutBegan The contacts that have begun.
+	 * @param OutPersisting The contacts that are still present.
+	 * @param OutEnded The contacts that have ended.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void
+	GetContactChanges(TArray<FBubbleCageContact>& OutBegan,
+					  TArray<FBubbleCageContact>& OutPersisting,
+					  TArray<FBubbleCageContact>& OutEnded) const
+	{
+		OutBegan = BeganContacts;
+		OutPersisting = PersistingContacts;
+		OutEnded = EndedContacts;
+	}
+
 	/**
 	 * Decouple the bubbles within the cage.
 	 * 
@@ -885,14 +3676,66 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 	void
 	Decouple()
 	{
+		WaitForEvaluation();
 		if (bDecoupleViaTrait)
 		{
-			DoDecouple<true>();
+			if (bPlanar)
+			{
+				DoDecouple<true, true>();
+			}
+			else
+			{
+				DoDecouple<true, false>();
+			}
 		}
 		else
 		{
-			DoDecouple<false>();
+			if (bPlanar)
+			{
+				DoDecouple<false, true>();
+			}
+			else
+			{
+				DoDecouple<false, false>();
+			}
+		}
+	}
+
+	/**
+	 * Re-register and iteratively decouple the bubbles.
+	 * 
+	 * The cage is filled once, while up to #SolverIterationsCount
+	 * decoupling passes are performed on it. Only the moved bubbles
+	 * get re-binned in between the passes, with the packed cells
+	 * being rebuilt only after drifting for more than a half of a cell.
+	 * 
+	 * @return The number of the passes actually performed.
+	 */
+	UFUNCTION(BlueprintCallable)
+	int32
+	Solve()
+	{
+		QUICK_SCOPE_CYCLE_COUNTER(STAT_BubbleCage_Solve);
+
+		WaitForEvaluation();
+		Update();
+		const auto IterationsNum = FMath::Max(1, SolverIterationsCount);
+		for (int32 Iteration = 1; Iteration <= IterationsNum; ++Iteration)
+		{
+			if ((Iteration > 1) && IsPacked() && (DisplacementSlack > CellSize * 0.5f))
+			{
+				Update();
+			}
+			// Only the first pass sees the bubbles as they came...
+			bFirstPass = (Iteration == 1);
+			Decouple();
+			bFirstPass = true;
+			if (MaxPenetration <= PenetrationTolerance)
+			{
+				return Iteration;
+			}
 		}
+		return IterationsNum;
 	}
 
 	/**
@@ -900,12 +3743,66 @@ class APPARATISTRUNTIME_API UBubbleCageComponent
 	 * 
 	 * The bubbles get updated within the cage after
 	 * the decoupling phase.
+	 * 
+	 * @see Solve()
 	 */
 	UFUNCTION(BlueprintCallable)
 	void
 	Evaluate()
 	{
-		Update();
-		Decouple();
+		Solve();
+	}
+
+	/**
+	 * Re-register and decouple the bubbles
+	 * on a background thread.
+	 * 
+	 * The evaluation is the same as the Solve() one,
+	 * while the calling thread is free to do some
+	 * unrelated work in the meantime. Neither the bubbles'
+	 * locations nor the cage may be accessed until the
+	 * evaluation is complete, so the queries are only
+	 * safe after the returned event has fired or
+	 * after the WaitForEvaluation() call.
+	 * 
+	 * The updating, the decoupling and the evaluating
+	 * methods wait for the pending evaluation on their own,
+	 * so a single cage is never evaluated twice at once.
+	 * 
+	 * The final deferred changes of the bubbles are applied
+	 * on the game thread within WaitForEvaluation(), while
+	 * those of the earlier passes (the despawns and the coupling
+	 * traits with multiple solver iterations or updates
+	 * in between) are applied by the passes themselves
+	 * on the worker thread. The actor-backed bubbles may not
+	 * be changed off the game thread at all, so the cage
+	 * gets evaluated synchronously (with a warning reported once),
+	 * unless #bActorBubbles is disabled.
+	 * 
+	 * @return The event fired once the evaluation is complete.
+	 */
+	FGraphEventRef
+	EvaluateAsync();
+
+	/**
+	 * Check if the asynchronous evaluation is still running.
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool
+	IsEvaluating() const
+	{
+		return PendingEvaluation.IsValid() && !PendingEvaluation->IsComplete();
 	}
+
+	/**
+	 * Wait for the pending asynchronous evaluation to complete.
+	 * 
+	 * Does nothing, if there is no evaluation pending
+	 * or if called from within the evaluation itself.
+	 * Applies the deferred changes of the evaluation,
+	 * so must be called on the game thread.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void
+	WaitForEvaluation();
 };
@@ -0,0 +1,68 @@
+/*
+ * ░▒▓ APPARATIST ▓▒░
+ * 
+ * File: BubbleCageContact.h
+ * Created: 2026-10-15 12:00:00
+ * Author: Vladislav Dmitrievich Turbanov (vladislav@turbanov.ru)
+ * ───────────────────────────────────────────────────────────────────
+ * 
+ * Community forums: https://talk.turbanov.ru
+ * 
+ * Copyright 2019 - 2023, SP Vladislav Dmitrievich Turbanov
+ * Made in Russia, Moscow City, Chekhov City ♡
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "SubjectHandle.h"
+
+#include "BubbleCageContact.generated.h"
+
+
+/**
+ * A pair of the bubbles touching each other.
+ * 
+ * The bubbles are always ordered by their identifiers,
+ * so the same pair gets the same contact.
+ */
+USTRUCT(BlueprintType, Category = "BubbleCage")
+struct APPARATISTRUNTIME_API FBubbleCageContact
+{
+	GENERATED_BODY()
+
+  public:
+
+	/// The bubble with the lesser identifier.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "BubbleCage")
+	FSubjectHandle SubjectA;
+
+	/// The bubble with the greater identifier.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "BubbleCage")
+	FSubjectHandle SubjectB;
+
+	/**
+	 * Get the key of the pair for the sorting.
+	 */
+	FORCEINLINE uint64
+	GetKey() const
+	{
+		return ((uint64)(uint32)SubjectA.GetId() << 32) | (uint64)(uint32)SubjectB.GetId();
+	}
+
+	/* Default constructor. */
+	FBubbleCageContact() {}
+
+	/* Construct a contact with the bubbles in any order. */
+	FBubbleCageContact(const FSubjectHandle& InSubjectA,
+					   const FSubjectHandle& InSubjectB)
+	  : SubjectA(InSubjectA)
+	  , SubjectB(InSubjectB)
+	{
+		if ((uint32)SubjectA.GetId() > (uint32)SubjectB.GetId())
+		{
+			Swap(SubjectA, SubjectB);
+		}
+	}
+};
@@ -0,0 +1,56 @@
+/*
+ * ░▒▓ APPARATIST ▓▒░
+ * 
+ * File: BubbleCageHit.h
+ * Created: 2026-10-15 12:00:00
+ * Author: Vladislav Dmitrievich Turbanov (vladislav@turbanov.ru)
+ * ───────────────────────────────────────────────────────────────────
+ * 
+ * Community forums: https://talk.turbanov.ru
+ * 
+ * Copyright 2019 - 2023, SP Vladislav Dmitrievich Turbanov
+ * Made in Russia, Moscow City, Chekhov City ♡
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "SubjectHandle.h"
+
+#include "BubbleCageHit.generated.h"
+
+
+/**
+ * A single hit of a cast through the bubble cage.
+ */
+USTRUCT(BlueprintType, Category = "BubbleCage")
+struct APPARATISTRUNTIME_API FBubbleCageHit
+{
+	GENERATED_BODY()
+
+  public:
+
+	/// The bubble being hit.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "BubbleCage")
+	FSubjectHandle Subject;
+
+	/**
+	 * The distance traveled along the cast before the hit.
+	 * 
+	 * Zero, if the cast has started already overlapping the bubble.
+	 */
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "BubbleCage")
+	float Distance = 0;
+
+	/// The location of the cast's center at the moment of the hit.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "BubbleCage")
+	FVector Location = FVector::ZeroVector;
+
+	/// The direction from the center of the bubble to the cast's center.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "BubbleCage")
+	FVector Normal = FVector::ZeroVector;
+
+	/* Default constructor. */
+	FBubbleCageHit() {}
+};
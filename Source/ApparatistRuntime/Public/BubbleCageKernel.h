@@ -0,0 +1,182 @@
+/*
+ * ░▒▓ APPARATIST ▓▒░
+ * 
+ * File: BubbleCageKernel.h
+ * Created: 2026-10-15 12:00:00
+ * Author: Vladislav Dmitrievich Turbanov (vladislav@turbanov.ru)
+ * ───────────────────────────────────────────────────────────────────
+ * 
+ * Community forums: https://talk.turbanov.ru
+ * 
+ * Copyright 2019 - 2023, SP Vladislav Dmitrievich Turbanov
+ * Made in Russia, Moscow City, Chekhov City ♡
+ */
+
+#pragma once
+
+#include <type_traits>
+
+#include "CoreMinimal.h"
+#include "Math/VectorRegister.h"
+
+#if PLATFORM_ALWAYS_HAS_AVX_2
+	#include <immintrin.h>
+#endif
+
+
+/**
+ * Should the vectorized narrow phase be used.
+ * 
+ * Set to 0 to force the scalar one.
+ */
+#ifndef BUBBLE_CAGE_SIMD
+	#define BUBBLE_CAGE_SIMD 1
+#endif
+
+/**
+ * The narrow phase of the bubble cage.
+ * 
+ * Tests a single sphere against a batch of packed
+ * candidate spheres at once.
+ */
+struct APPARATISTRUNTIME_API FBubbleCageKernel
+{
+	/**
+	 * The number of candidates tested per a single instruction.
+	 * 
+	 * The packed arrays have to be padded with
+	 * at least (Width - 1) additional elements.
+	 */
+#if BUBBLE_CAGE_SIMD && PLATFORM_ALWAYS_HAS_AVX_2
+	static constexpr int32 Width = 8;
+#elif BUBBLE_CAGE_SIMD
+	static constexpr int32 Width = 4;
+#else
+	static constexpr int32 Width = 1;
+#endif
+
+	/**
+	 * Invoke a visiting functor, respecting its early-out.
+	 * 
+	 * The functor may either return nothing or
+	 * a boolean value to continue the iterating with.
+	 * 
+	 * @return Should the iterating continue.
+	 */
+	template < typename FunctorT, typename... ArgsT >
+	static FORCEINLINE bool
+	Visit(FunctorT&& Functor, ArgsT&&... Args)
+	{
+		if constexpr (std::is_void<decltype(Functor(Forward<ArgsT>(Args)...))>::value)
+		{
+			Functor(Forward<ArgsT>(Args)...);
+			return true;
+		}
+		else
+		{
+			return (bool)Functor(Forward<ArgsT>(Args)...);
+		}
+	}
+
+	/**
+	 * Test a sphere against the batch of candidates.
+	 * 
+	 * Exactly #Width candidates are read.
+	 * 
+	 * @tparam bPlanar Should the Z-coordinates be ignored.
+	 * @param Location The center of the sphere.
+	 * @param Radius The radius of the sphere.
+	 * @param X The X-coordinates of the candidates.
+	 * @param Y The Y-coordinates of the candidates.
+	 * @param Z The Z-coordinates of the candidates.
+	 * @param Radii The radii of the candidates.
+	 * @return The mask of the candidates overlapping the sphere.
+	 */
+	template < bool bPlanar = false >
+	static FORCEINLINE uint32
+	Overlap(const FVector3f& Location,
+			const float      Radius,
+			const float*     X,
+			const float*     Y,
+			const float*     Z,
+			const float*     Radii)
+	{
+#if BUBBLE_CAGE_SIMD && PLATFORM_ALWAYS_HAS_AVX_2
+		const __m256 DX = _mm256_sub_ps(_mm256_set1_ps(Location.X), _mm256_loadu_ps(X));
+		const __m256 DY = _mm256_sub_ps(_mm256_set1_ps(Location.Y), _mm256_loadu_ps(Y));
+		__m256 DistanceSqr = _mm256_add_ps(_mm256_mul_ps(DX, DX), _mm256_mul_ps(DY, DY));
+		if (!bPlanar) // Compile-time branch.
+		{
+			const __m256 DZ = _mm256_sub_ps(_mm256_set1_ps(Location.Z), _mm256_loadu_ps(Z));
+			DistanceSqr = _mm256_add_ps(DistanceSqr, _mm256_mul_ps(DZ, DZ));
+		}
+		const __m256 Reach = _mm256_add_ps(_mm256_set1_ps(Radius), _mm256_loadu_ps(Radii));
+		return (uint32)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_mul_ps(Reach, Reach), DistanceSqr, _CMP_GT_OQ));
+#elif BUBBLE_CAGE_SIMD
+		const auto DX = VectorSubtract(VectorSetFloat1(Location.X), VectorLoad(X));
+		const auto DY = VectorSubtract(VectorSetFloat1(Location.Y), VectorLoad(Y));
+		auto DistanceSqr = VectorMultiply(DX, DX);
+		DistanceSqr = VectorMultiplyAdd(DY, DY, DistanceSqr);
+		if (!bPlanar) // Compile-time branch.
+		{
+			const auto DZ = VectorSubtract(VectorSetFloat1(Location.Z), VectorLoad(Z));
+			DistanceSqr = VectorMultiplyAdd(DZ, DZ, DistanceSqr);
+		}
+		const auto Reach = VectorAdd(VectorSetFloat1(Radius), VectorLoad(Radii));
+		return (uint32)VectorMaskBits(VectorCompareGT(VectorMultiply(Reach, Reach), DistanceSqr));
+#else
+		const auto Delta = Location - FVector3f(*X, *Y, bPlanar ? Location.Z : *Z);
+		return (FMath::Square(Radius + *Radii) > Delta.SizeSquared()) ? 1u : 0u;
+#endif
+	}
+
+	/**
+	 * Iterate the packed candidates overlapping a sphere.
+	 * 
+	 * @tparam bPlanar Should the Z-coordinates be ignored.
+	 * @param Location The center of the sphere.
+	 * @param Radius The radius of the sphere.
+	 * @param X The X-coordinates of the candidates.
+	 * @param Y The Y-coordinates of the candidates.
+	 * @param Z The Z-coordinates of the candidates.
+	 * @param Radii The radii of the candidates.
+	 * @param Begin The first candidate to test.
+	 * @param End The candidate past the last one to test.
+	 * @param Functor The functor to call with the index
+	 * of each of the overlapping candidates. May return
+	 * @c false to stop the iterating.
+	 * @return Was the iterating completed without an early-out.
+	 */
+	template < bool bPlanar = false, typename FunctorT >
+	static FORCEINLINE bool
+	ForEachOverlapping(const FVector3f& Location,
+					   const float      Radius,
+					   const float*     X,
+					   const float*     Y,
+					   const float*     Z,
+					   const float*     Radii,
+					   const int32      Begin,
+					   const int32      End,
+					   FunctorT&&       Functor)
+	{
+		for (int32 i = Begin; i < End; i += Width)
+		{
+			auto Mask = Overlap<bPlanar>(Location, Radius, X + i, Y + i, Z + i, Radii + i);
+			if (End - i < Width)
+			{
+				// Mask out the padding and the following cells...
+				Mask &= (1u << (End - i)) - 1u;
+			}
+			while (Mask)
+			{
+				const auto Lane = FMath::CountTrailingZeros(Mask);
+				Mask &= Mask - 1u;
+				if (!Visit(Functor, i + (int32)Lane))
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+}; //-struct FBubbleCageKernel
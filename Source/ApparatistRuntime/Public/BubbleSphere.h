@@ -50,11 +50,77 @@ struct APPARATISTRUNTIME_API FBubbleSphere
 			  Meta = (ClampMin="0"))
 	float DecoupleProportion = 1.0f;
 
+	/**
+	 * The collision layers this sphere belongs to.
+	 * 
+	 * The spheres are decoupled only if each of them
+	 * has the other's layers within its mask.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "BubbleCage",
+			  Meta = (Bitmask))
+	int32 CollisionLayers = 1;
+
+	/**
+	 * The collision layers this sphere gets decoupled from.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "BubbleCage",
+			  Meta = (Bitmask))
+	int32 CollisionMask = -1;
+
 	/**
 	 * The index of the current cell.
 	 */
 	int32 CellIndex = -1;
 
+	/**
+	 * The index of the subject within its unpacked cell.
+	 * 
+	 * Only valid when the cage is updated via the locking.
+	 */
+	int32 CellSlot = -1;
+
+	/**
+	 * The index of the subject within the packed subjects array.
+	 * 
+	 * Only valid when the cage is updated via a counting sort.
+	 */
+	int32 PackedIndex = -1;
+
+	/**
+	 * The single-precision location of the sphere
+	 * relative to the minimum of the cage's bounds.
+	 * 
+	 * Snapshotted each time the sphere gets registered within
+	 * the unpacked cells or decoupled, so the neighbours are
+	 * tested without fetching the world-precision location.
+	 */
+	FVector3f CageLocation = FVector3f::ZeroVector;
+
+	/**
+	 * The cage-local location the sphere
+	 * has been resting at.
+	 */
+	FVector3f RestLocation = FVector3f::ZeroVector;
+
+	/**
+	 * The number of the consecutive evaluations
+	 * the sphere has been resting for.
+	 */
+	int32 RestingCount = 0;
+
+	/**
+	 * The cage-local location the sphere is to be swept from
+	 * during the next evaluation.
+	 * 
+	 * Only used in the swept decoupling mode.
+	 */
+	FVector3f SweptLocation = FVector3f::ZeroVector;
+
+	/**
+	 * Was the swept location recorded already.
+	 */
+	bool bSwept = false;
+
 	/// The accumulated decoupling force.
 	FVector AccumulatedDecouple = FVector::ZeroVector;
 